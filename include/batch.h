@@ -0,0 +1,51 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "catalog.h"
+
+/* --------------------------------------------------------------------- */
+/*  Batch queue: queue.txt in the USB homebrew folder                    */
+/*  One title id per line ('#' or ';' starts a comment):                 */
+/*      CUSA12345                                                        */
+/*      PPSA01234                                                        */
+/*  A line with nothing after the title id is pending. Each title is     */
+/*  resolved, copied, checked and decrypted in turn, and its line is     */
+/*  rewritten as "<title> done <date>" or "<title> failed <reason>";     */
+/*  delete the status to queue a title again.                            */
+/*                                                                       */
+/*  Titles must be mounted under the sandbox; a PS4 title that is not    */
+/*  can still be dumped from its installed app.pkg / patch.pkg.          */
+/*  SELF decryption runs on its own thread, one title behind the copy,   */
+/*  so title N is decrypted while title N+1 is copied.                   */
+/*  batch_summary.txt and the log get one line per title at the end.     */
+/* --------------------------------------------------------------------- */
+#define BATCH_QUEUE_FILE    "queue.txt"
+#define BATCH_SUMMARY_FILE  "batch_summary.txt"
+#define BATCH_MAX_TITLES    256
+
+/* Pending titles in queue.txt, 0 if there is no queue. */
+int batch_pending(const char *usb);
+
+/* Dumps every pending title. cat may be NULL (no package fallback,
+   no size check). Returns the number of titles that failed, -1 if the
+   queue could not be read. */
+int batch_run(const char *sandbox, const char *usb, const struct catalog *cat,
+              int do_decrypt, int do_elf2fself, int do_backport);
+
+#endif /* BATCH_H */
@@ -0,0 +1,60 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdint.h>
+
+/* --------------------------------------------------------------------- */
+/*  Installed-title catalog                                              */
+/*  One entry per app.pkg / patch.pkg under /user and /mnt/ext0-1.       */
+/*  Only package headers and appmeta are read, never title data:         */
+/*    PS4  content id from the CNT header, version from the package's    */
+/*         param.sfo entry (appmeta param.sfo if it has none)            */
+/*    PS5  content id and version from appmeta param.json                */
+/*  catalog.tsv on the USB keeps the result; an entry is read again      */
+/*  only when its package size or mtime (or its appmeta) changed.        */
+/* --------------------------------------------------------------------- */
+#define CATALOG_FILE  "catalog.tsv"
+
+struct catalog_entry {
+    char     title_id[16];
+    char     kind[8];           /* "app" / "patch" */
+    char     version[16];       /* "" if unknown */
+    char     content_id[48];
+    uint64_t size;              /* package bytes */
+    int64_t  mtime;             /* package */
+    int64_t  meta_mtime;        /* appmeta file the version came from, 0 if none */
+    char     path[256];
+};
+
+struct catalog {
+    struct catalog_entry *items;    /* sorted by title id, kind, then install root */
+    size_t count;
+    size_t cap;
+    size_t refreshed;               /* entries read from disk this scan */
+};
+
+/* root prefixes every console path ("" on the console). cache_dir holds
+   catalog.tsv; NULL scans without a cache. Returns 0 or -1. */
+int  catalog_scan(struct catalog *cat, const char *root, const char *cache_dir);
+/* the copy on internal storage when a title is installed more than once */
+const struct catalog_entry *catalog_find(const struct catalog *cat,
+                                         const char *title_id, const char *kind);
+void catalog_free(struct catalog *cat);
+
+#endif /* CATALOG_H */
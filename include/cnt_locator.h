@@ -0,0 +1,38 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef CNT_LOCATOR_H
+#define CNT_LOCATOR_H
+
+#include <stdint.h>
+
+#include "pkg.h"
+
+/* --------------------------------------------------------------------- */
+/*  Where the CNT package (app_sc.pkg) starts inside a PS5 app.pkg.      */
+/*  Tried in order, every candidate checked for the CNT magic:           */
+/*    1. the outer header (app.pkg that is itself a CNT package) and     */
+/*       the app_sc.pkg piece of app.json next to it                     */
+/*    2. cnt_cache.txt on the USB (title id -> offset, by package size)  */
+/*    3. a scan of the package tail; the result goes into the cache      */
+/* --------------------------------------------------------------------- */
+#define CNT_CACHE_FILE  "cnt_cache.txt"
+
+/* size is 0 when only a scan found the offset; a mapped view is
+   scanned in place */
+int cnt_locate(const struct pkg_view *v, uint64_t *offset, uint64_t *size);
+
+#endif /* CNT_LOCATOR_H */
@@ -0,0 +1,37 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+/* --------------------------------------------------------------------- */
+/*  include = / exclude = glob rules from config.ini                     */
+/*  Patterns without '/' match a file or directory name, patterns with   */
+/*  '/' match the path relative to the app root. A directory matching    */
+/*  an include keeps everything below it; one matching an exclude is     */
+/*  skipped without being opened.                                        */
+/* --------------------------------------------------------------------- */
+#define FILTER_SKIP      0
+#define FILTER_KEEP      1   /* directory: walk it, children decide */
+#define FILTER_KEEP_ALL  2   /* directory: keep everything below */
+
+int  filter_load(void);     /* number of rules read */
+int  filter_active(void);
+
+/* rel_path: relative, '/' separated; inherited: parent was FILTER_KEEP_ALL */
+int  filter_check(const char *rel_path, int is_dir, int inherited);
+
+#endif /* FILTER_H */
@@ -19,10 +19,13 @@ along with this program; see the file COPYING. If not, see
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
 
 /* --------------------------------------------------------------------- */
 /*  PFS structures (packed)                                              */
 /* --------------------------------------------------------------------- */
+#define PFS_MAGIC  20130315ULL   /* pfs_header_t.magic */
+
 struct pfs_header_t {
     uint64_t version;
     uint64_t magic;
@@ -66,14 +69,147 @@ struct dirent_t {
     /* name follows */
 } __attribute__((packed));
 
+/* --------------------------------------------------------------------- */
+/*  Compact in-memory inode – only the fields traversal needs           */
+/* --------------------------------------------------------------------- */
+#define PFS_NDADDR      12           /* direct block pointers   */
+#define PFS_NIADDR      5            /* indirect block pointers */
+#define PFS_INODE_PTRS  (PFS_NDADDR + PFS_NIADDR)
+#define PFS_NO_PTRS     0xFFFFFFFFU
+#define PFS_INODE_COMPRESSED  0x1    /* di_d32.flags: data is a PFSC stream */
+
+struct pfs_inode {
+    uint64_t size;
+    uint64_t size_compressed;
+    uint32_t db0;       /* first data block */
+    uint32_t blocks;
+    uint32_t ptrs;      /* index into pfs_image.block_ptrs, or PFS_NO_PTRS */
+    uint32_t flags;
+    uint16_t mode;
+};
+
 /* --------------------------------------------------------------------- */
 /*  Progress callback – matches utils.c system                           */
 /* --------------------------------------------------------------------- */
 typedef void (*pfs_progress_cb)(uint64_t copied, uint64_t total, const char *current_file);
 
+/* --------------------------------------------------------------------- */
+/*  Opened image + parsed tree                                          */
+/* --------------------------------------------------------------------- */
+#define PFS_NODE_FILE  2
+#define PFS_NODE_DIR   3
+
+struct pfs_extent {
+    uint64_t offset;        /* byte offset inside the image */
+    uint64_t length;
+};
+
+struct pfs_node {
+    const char *path;       /* relative to the image root, "" for the root */
+    uint64_t    size;
+    uint64_t    stored_size;    /* bytes on disk (compressed size for PFSC) */
+    uint32_t    ino;
+    uint32_t    parent;     /* index of the parent directory node */
+    uint32_t    extent_first;
+    uint32_t    extent_count;
+    uint8_t     type;       /* PFS_NODE_FILE / PFS_NODE_DIR */
+    uint8_t     compressed;
+};
+
+struct pfs_arena;
+
+struct pfs_tree {
+    struct pfs_node   *nodes;       /* pre-order: parents precede children */
+    size_t             node_count;
+    struct pfs_extent *extents;
+    size_t             extent_count;
+    uint64_t           total_size;
+    size_t             file_count;
+    size_t             dir_count;
+    size_t             compressed_count;
+    struct pfs_arena  *arena;       /* backing storage for paths */
+    char              *path_blob;   /* path storage when loaded from an index */
+};
+
+#define PFS_BACKEND_PREAD  0    /* explicit reads into heap buffers */
+#define PFS_BACKEND_MMAP   1    /* windowed mappings, falls back to pread */
+
+/* One mapped slice of the image; each reader thread owns its own */
+struct pfs_window {
+    uint8_t *base;
+    uint64_t off;           /* file offset of base, page aligned */
+    size_t   len;
+    uint64_t advised;       /* WILLNEED issued up to this file offset */
+    uint64_t dropped;       /* DONTNEED issued below this file offset */
+};
+
+struct pfs_image {
+    int                 fd;
+    int                 backend;        /* PFS_BACKEND_* */
+    uint64_t            file_size;
+    uint64_t            base;           /* file offset of the image (PKG body) */
+    uint64_t            size;           /* image bytes from base */
+    struct pfs_header_t hdr;
+    struct pfs_inode   *inodes;
+    size_t              inode_count;
+    uint32_t           *block_ptrs;     /* PFS_INODE_PTRS per multi-block inode */
+    size_t              block_ptr_count;
+};
+
 /* --------------------------------------------------------------------- */
 /*  Public API – now with progress                                       */
 /* --------------------------------------------------------------------- */
+int  pfs_open(struct pfs_image *img, const char *pfs_path, int backend);
+int  pfs_open_range(struct pfs_image *img, const char *pfs_path, uint64_t base,
+                    uint64_t size, int backend);
+int  pfs_read(const struct pfs_image *img, void *buf, size_t len, uint64_t off);
+void pfs_close(struct pfs_image *img);
+
+/* Open and get the tree: cached index on the USB first, then a full parse.
+   *filtered is set when include/exclude rules were applied while parsing. */
+int  pfs_open_tree(const char *pfs_path, uint64_t base, uint64_t size,
+                   struct pfs_image *img, struct pfs_tree *tree, int *filtered);
+int  pfs_tree_build(struct pfs_image *img, struct pfs_tree *tree);
+void pfs_tree_free(struct pfs_tree *tree);
+const struct pfs_node *pfs_tree_find(const struct pfs_tree *tree, const char *path);
+
+#define PFS_SELECT_DIR  1   /* parent of a selected file: created, not copied */
+#define PFS_SELECT_ALL  2   /* selected file, or directory with its contents */
+
+/* select: one byte per node; paths are files or directories, "" = all */
+size_t pfs_tree_select(const struct pfs_tree *tree, const char *const *paths,
+                       size_t npaths, uint8_t *select, uint64_t *bytes);
+/* same marks from the config.ini include/exclude rules; with g_route_self,
+   SELFs in img (NULL: not checked) are left to the decrypter */
+size_t pfs_tree_filter(struct pfs_image *img, const struct pfs_tree *tree,
+                       uint8_t *select, uint64_t *bytes);
+
+/* One file's stored bytes at a logical offset, across its extents */
+int  pfs_node_read(struct pfs_image *img, const struct pfs_tree *tree,
+                   const struct pfs_node *node, uint64_t off, void *buf, size_t len);
+/* Decompress one PFSC file inline into out_fd; -1 if it is not PFSC */
+int  pfs_node_inflate(struct pfs_image *img, const struct pfs_tree *tree,
+                      const struct pfs_node *node, int out_fd, uint64_t *written);
+
+/* threads: files extracted concurrently (1 = serial), reads stay in image order */
+int  pfs_extract(struct pfs_image *img, const struct pfs_tree *tree,
+                 const char *out_dir, int threads, pfs_progress_cb progress);
+int  pfs_extract_select(struct pfs_image *img, const struct pfs_tree *tree,
+                        const char *out_dir, const uint8_t *select,
+                        int threads, pfs_progress_cb progress);
+
+/* Read up to 'limit' bytes of file data with both backends, log MB/s */
+void pfs_benchmark(struct pfs_image *img, const struct pfs_tree *tree, uint64_t limit);
+
 int unpfs(const char *pfs_path, const char *out_dir, pfs_progress_cb progress);
+int unpfs_range(const char *pfs_path, uint64_t base, uint64_t size,
+                const char *out_dir, pfs_progress_cb progress);
+int unpfs_select(const char *pfs_path, const char *out_dir, const char *const *paths,
+                 size_t npaths, pfs_progress_cb progress);
+int unpfs_list(const char *pfs_path, FILE *out);
+
+/* Where 'file' sits in the file holding the image, if stored raw in one extent */
+int pfs_locate_file(const char *pfs_path, uint64_t base, uint64_t size, const char *file,
+                    uint64_t *out_base, uint64_t *out_size);
 
 #endif /* PFS_H */
\ No newline at end of file
@@ -0,0 +1,78 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef PFS_INDEX_H
+#define PFS_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pfs.h"
+
+/* --------------------------------------------------------------------- */
+/*  PFS index sidecar: parsed tree saved to USB, keyed by the image      */
+/* --------------------------------------------------------------------- */
+#define PFS_INDEX_MAGIC     0x49534650U   /* "PFSI" */
+#define PFS_INDEX_VERSION   1
+#define PFS_INDEX_KEY_SIZE  32            /* SHA-256 */
+
+struct pfs_index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t  key[PFS_INDEX_KEY_SIZE];     /* image fingerprint */
+    uint8_t  body_sha[PFS_INDEX_KEY_SIZE];
+    uint64_t body_size;
+    uint64_t node_count;
+    uint64_t extent_count;
+    uint64_t path_bytes;
+    uint64_t total_size;
+    uint64_t file_count;
+    uint64_t dir_count;
+    uint64_t compressed_count;
+} __attribute__((packed));
+
+/* body: node records, then the extents, then NUL-terminated paths */
+struct pfs_index_node {
+    uint64_t size;
+    uint64_t stored_size;
+    uint32_t path_off;
+    uint32_t ino;
+    uint32_t parent;
+    uint32_t extent_first;
+    uint32_t extent_count;
+    uint8_t  type;
+    uint8_t  compressed;
+    uint8_t  pad[2];
+} __attribute__((packed));
+
+/* --------------------------------------------------------------------- */
+/*  Public API                                                          */
+/* --------------------------------------------------------------------- */
+/* Fingerprint: image size and mtime, header block and first inode block */
+int  pfs_index_key(struct pfs_image *img, uint8_t key[PFS_INDEX_KEY_SIZE]);
+
+/* <dir>/pfs_index/<first 8 key bytes in hex>.pfsi */
+void pfs_index_path(const uint8_t key[PFS_INDEX_KEY_SIZE], const char *dir,
+                    char *out, size_t out_size);
+
+int  pfs_index_save(const struct pfs_tree *tree, const uint8_t key[PFS_INDEX_KEY_SIZE],
+                    const char *path);
+
+/* Fails (tree untouched) on a missing, stale or damaged index */
+int  pfs_index_load(struct pfs_tree *tree, const uint8_t key[PFS_INDEX_KEY_SIZE],
+                    const char *path);
+
+#endif /* PFS_INDEX_H */
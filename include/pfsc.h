@@ -0,0 +1,60 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef PFSC_H
+#define PFSC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* --------------------------------------------------------------------- */
+/*  PFSC (compressed PFS file) header (packed)                           */
+/* --------------------------------------------------------------------- */
+#define PFSC_MAGIC  0x43534650U   /* "PFSC" */
+
+struct pfsc_header_t {
+    uint32_t magic;
+    uint32_t unk4;
+    uint32_t unk8;
+    uint32_t block_sz;
+    uint64_t block_sz2;
+    uint64_t block_offsets;     /* (nblocks + 1) uint64 offsets */
+    uint64_t data_start;
+    uint64_t data_length;       /* decompressed size */
+} __attribute__((packed));
+
+/* Reads 'len' bytes of the compressed stream at logical offset 'off' */
+typedef int (*pfsc_read_fn)(void *ctx, uint64_t off, void *buf, size_t len);
+
+struct pfsc_pool;
+
+/* --------------------------------------------------------------------- */
+/*  Public API                                                          */
+/* --------------------------------------------------------------------- */
+struct pfsc_pool *pfsc_pool_create(int threads);
+void pfsc_pool_destroy(struct pfsc_pool *pool);
+
+int pfsc_is_compressed(pfsc_read_fn read, void *ctx, uint64_t stored_size);
+
+/* First 'len' decompressed bytes (at most one block) into buf */
+int pfsc_read_head(pfsc_read_fn read, void *ctx, uint64_t stored_size, void *buf, size_t len);
+
+/* Decompress a whole PFSC stream into out_fd, blocks in parallel on 'pool'
+ * (NULL = inline). Output is written strictly in order. */
+int pfsc_extract(struct pfsc_pool *pool, pfsc_read_fn read, void *ctx,
+                 uint64_t stored_size, int out_fd, uint64_t *written);
+
+#endif /* PFSC_H */
@@ -0,0 +1,214 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef PKG_H
+#define PKG_H
+
+#include <stdint.h>
+
+/* --------------------------------------------------------------------- */
+/*  PKG constants                                                       */
+/* --------------------------------------------------------------------- */
+#define PS4_PKG_MAGIC  0x7F434E54U   // PS4
+#define PS5_PKG_MAGIC  0x4849467FU   // PS5
+
+/* header and table fields are stored big-endian */
+static inline uint16_t pkg_be16(uint16_t v) {
+    return (uint16_t)(((v & 0x00FFU) << 8) | ((v & 0xFF00U) >> 8));
+}
+
+static inline uint32_t pkg_be32(uint32_t v) {
+    return ((v & 0x000000FFUL) << 24) |
+           ((v & 0x0000FF00UL) <<  8) |
+           ((v & 0x00FF0000UL) >>  8) |
+           ((v & 0xFF000000UL) >> 24);
+}
+
+/* --------------------------------------------------------------------- */
+/*  PKG entry type enumeration                                          */
+/* --------------------------------------------------------------------- */
+enum PS4_PKG_ENTRY_TYPES {
+    PS4_PKG_ENTRY_TYPE_DIGEST_TABLE   = 0x0001,
+    PS4_PKG_ENTRY_TYPE_0x800          = 0x0010,
+    PS4_PKG_ENTRY_TYPE_0x200          = 0x0020,
+    PS4_PKG_ENTRY_TYPE_0x180          = 0x0080,
+    PS4_PKG_ENTRY_TYPE_META_TABLE     = 0x0100,
+    PS4_PKG_ENTRY_TYPE_NAME_TABLE     = 0x0200,
+    PS4_PKG_ENTRY_TYPE_LICENSE        = 0x0400,
+    PS4_PKG_ENTRY_TYPE_FILE1          = 0x1000,
+    PS4_PKG_ENTRY_TYPE_FILE2          = 0x1200
+};
+
+/* --------------------------------------------------------------------- */
+/*  PKG main header (packed)                                            */
+/* --------------------------------------------------------------------- */
+struct cnt_pkg_main_header {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t unk_0x08;
+    uint32_t unk_0x0C;
+    uint16_t unk1_entries_num;
+    uint16_t table_entries_num;
+    uint16_t system_entries_num;
+    uint16_t unk2_entries_num;
+    uint32_t file_table_offset;
+    uint32_t main_entries_data_size;
+    uint32_t unk_0x20;
+    uint32_t body_offset;
+    uint32_t unk_0x28;
+    uint32_t body_size;
+    uint8_t  unk_0x30[0x10];
+    uint8_t  content_id[0x30];
+    uint32_t unk_0x70;
+    uint32_t unk_0x74;
+    uint32_t unk_0x78;
+    uint32_t unk_0x7C;
+    uint32_t date;
+    uint32_t time;
+    uint32_t unk_0x88;
+    uint32_t unk_0x8C;
+    uint8_t  unk_0x90[0x70];
+    uint8_t  main_entries1_digest[0x20];
+    uint8_t  main_entries2_digest[0x20];
+    uint8_t  digest_table_digest[0x20];
+    uint8_t  body_digest[0x20];
+} __attribute__((packed));
+
+/* --------------------------------------------------------------------- */
+/*  PKG content header (packed)                                         */
+/* --------------------------------------------------------------------- */
+struct cnt_pkg_content_header {
+    uint32_t unk_0x400;
+    uint32_t unk_0x404;
+    uint32_t unk_0x408;
+    uint32_t unk_0x40C;
+    uint32_t unk_0x410;
+    uint32_t content_offset;
+    uint32_t unk_0x418;
+    uint32_t content_size;
+    uint32_t unk_0x420;
+    uint32_t unk_0x424;
+    uint32_t unk_0x428;
+    uint32_t unk_0x42C;
+    uint32_t unk_0x430;
+    uint32_t unk_0x434;
+    uint32_t unk_0x438;
+    uint32_t unk_0x43C;
+    uint8_t  content_digest[0x20];
+    uint8_t  content_one_block_digest[0x20];
+} __attribute__((packed));
+
+/* --------------------------------------------------------------------- */
+/*  PKG table entry (packed)                                            */
+/* --------------------------------------------------------------------- */
+struct cnt_pkg_table_entry {
+    uint32_t type;
+    uint32_t unk1;
+    uint32_t flags1;
+    uint32_t flags2;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t unk2;
+    uint32_t unk3;
+} __attribute__((packed));
+
+/* --------------------------------------------------------------------- */
+/*  Helper structures                                                   */
+/* --------------------------------------------------------------------- */
+struct file_entry {
+    int   offset;
+    int   size;
+    char *name;
+};
+
+/* --------------------------------------------------------------------- */
+/*  Package view: the file is opened and mapped read-only once; the      */
+/*  table is decoded per entry on first use and entry data is handed     */
+/*  out as pointers into the mapping. Without a mapping the same calls   */
+/*  fall back to pread.                                                  */
+/* --------------------------------------------------------------------- */
+struct pkg_entry {
+    uint32_t type;
+    uint32_t flags1;
+    uint32_t flags2;
+    uint32_t offset;        /* relative to the view's base */
+    uint32_t size;
+};
+
+struct pkg_view {
+    int            fd;
+    char           path[512];
+    uint64_t       file_size;
+    const uint8_t *map;             /* whole file, NULL if mmap failed */
+    uint64_t       base;            /* file offset of the CNT header */
+    struct cnt_pkg_main_header hdr; /* as on disk (big-endian fields) */
+    uint32_t       table_offset;
+    uint16_t       entry_count;
+    const uint8_t *table;           /* raw entries, in the mapping or table_copy */
+    uint8_t       *table_copy;
+    struct pkg_entry *entries;
+    uint8_t       *decoded;
+    uint16_t      *hash;            /* type -> index + 1, open addressing */
+    size_t         hash_size;
+};
+
+int  pkg_view_open(struct pkg_view *v, const char *path);
+/* parse the CNT header and table at 'base' (0, or inside a PS5 app.pkg) */
+int  pkg_view_load(struct pkg_view *v, uint64_t base);
+void pkg_view_close(struct pkg_view *v);
+
+const struct pkg_entry *pkg_view_entry(struct pkg_view *v, uint16_t i);
+const struct pkg_entry *pkg_view_find(struct pkg_view *v, uint32_t type);
+
+/* off is a file offset; ptr is NULL when unmapped or out of range */
+const uint8_t *pkg_view_ptr(const struct pkg_view *v, uint64_t off, uint64_t len);
+int  pkg_view_read(const struct pkg_view *v, void *buf, size_t len, uint64_t off);
+
+/* --------------------------------------------------------------------- */
+/*  Name table (entry type 0x0200): NUL separated names, copied out of   */
+/*  the view in one piece and indexed in place                          */
+/* --------------------------------------------------------------------- */
+struct pkg_names {
+    char     *pool;         /* the table itself, NUL terminated strings */
+    uint32_t *index;        /* offset of each name in pool */
+    size_t    count;
+};
+
+int  pkg_names_load(struct pkg_view *v, struct pkg_names *names);
+void pkg_names_free(struct pkg_names *names);
+
+static inline char *pkg_name(const struct pkg_names *names, size_t i)
+{
+    return i < names->count ? names->pool + names->index[i] : NULL;
+}
+
+/* --------------------------------------------------------------------- */
+/*  Entry extraction in ascending package offset, written straight from  */
+/*  the mapping (or through one fixed pread buffer without it)           */
+/* --------------------------------------------------------------------- */
+#define PKG_COPY_BUF  0x100000
+
+struct pkg_job {
+    uint64_t    offset;     /* relative to the view's base */
+    uint64_t    size;
+    const char *name;       /* path below out_dir */
+};
+
+/* Sorts jobs by offset; returns the number of files written */
+int pkg_extract_jobs(struct pkg_view *v, struct pkg_job *jobs, size_t njobs,
+                     const char *out_dir);
+
+#endif /* PKG_H */
\ No newline at end of file
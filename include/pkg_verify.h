@@ -0,0 +1,53 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef PKG_VERIFY_H
+#define PKG_VERIFY_H
+
+#include <stdint.h>
+
+#include "pkg.h"
+
+/* --------------------------------------------------------------------- */
+/*  Package digest check (config verify_pkg = 1)                         */
+/*  Recomputes, on a view loaded by unpkg_ps4 / unpkg_ps5:               */
+/*    body_digest          SHA-256 of the body (header 0x20 / 0x28)      */
+/*    pfs_image_digest     SHA-256 of the PFS image (0x410 / 0x418)      */
+/*    main_entries1/2      SHA-256 of the data of the first 0x14 / 0x16  */
+/*                         table entries, in table order; a mismatch     */
+/*                         with the body intact is logged, not failed    */
+/*    digest_table_digest  SHA-256 of the digest table entry (0x0001)    */
+/*    per entry            digest table slot i against entry i's data,   */
+/*                         for plaintext entries with a non-zero slot,   */
+/*                         only when the digest table itself matches     */
+/*  Each region is independent and hashed whole by one of the workers,   */
+/*  largest first. The PFS signed digest and the header signatures are   */
+/*  not verified.                                                        */
+/* --------------------------------------------------------------------- */
+#define PKG_VERIFY_THREADS  4
+
+struct pkg_verify_result {
+    int      checked;       /* regions compared */
+    int      failed;        /* digest mismatch or unreadable */
+    uint64_t bytes;         /* hashed */
+    double   secs;
+};
+
+/* 0 = all checked regions match, 1 = nothing could be checked,
+   -1 = a mismatch or read error. res may be NULL. */
+int pkg_verify(struct pkg_view *v, int threads, struct pkg_verify_result *res);
+
+#endif /* PKG_VERIFY_H */
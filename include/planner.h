@@ -0,0 +1,45 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <stdint.h>
+
+/* --------------------------------------------------------------------- */
+/*  Dump source planner                                                  */
+/*  A title can be read from its raw pfs_image.dat (unpfs, sequential)   */
+/*  or from the mounted sandbox (one lookup per file). The planner       */
+/*  takes file count and sizes from the image tree, times a short read   */
+/*  of each source and picks the one predicted to finish first.          */
+/* --------------------------------------------------------------------- */
+#define PLAN_AUTO     0     /* config pfs_source = auto (default) */
+#define PLAN_IMAGE    1
+#define PLAN_SANDBOX  2
+
+struct pfs_plan {
+    int      source;        /* PLAN_IMAGE / PLAN_SANDBOX */
+    uint64_t files;
+    uint64_t bytes;
+    double   image_secs;    /* predicted, 0 if not measured */
+    double   sandbox_secs;  /* predicted, 0 if not measured */
+};
+
+/* Returns PLAN_IMAGE, PLAN_SANDBOX, or -1 if neither source is usable.
+   plan may be NULL; the decision is always written to the log. */
+int plan_pfs_source(const char *image_path, const char *sandbox_dir, struct pfs_plan *plan);
+
+#endif /* PLANNER_H */
@@ -25,4 +25,12 @@ int dump_ps4_cusa_app(const char *title_id,
                       int do_elf2fself,
                       int do_backport);
 
+/* SELF decryption only, into the folders a dump with do_decrypt = 0 wrote */
+int decrypt_ps4_cusa_app(const char *title_id,
+                         const char *app_folder,
+                         const char *patch_folder,
+                         const char *usb_path,
+                         int do_elf2fself,
+                         int do_backport);
+
 #endif
\ No newline at end of file
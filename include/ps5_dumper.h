@@ -26,4 +26,13 @@ int dump_ps5_ppsa_app(
     int do_backport
 );
 
+/* Step 10 of dump_ps5_ppsa_app() on its own: decrypt the SELFs of a dump */
+int decrypt_ps5_ppsa_app(
+    const char *sandbox,
+    const char *app_folder,
+    const char *usb_path,
+    int do_elf2fself,
+    int do_backport
+);
+
 #endif
\ No newline at end of file
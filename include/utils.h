@@ -18,6 +18,7 @@ along with this program; see the file COPYING. If not, see
 #define UTILS_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <time.h>
 #include <sys/types.h>
@@ -53,6 +54,14 @@ int fs_copy_file(const char *src, const char *dst);
 int copy_file_track(const char *src, const char *dst);
 void copy_dir_recursive_tracked(const char *src, const char *dst);
 void size_walker(const char *path, size_t *acc);
+void copy_dir_filtered(const char *src, const char *dst);      // honours include/exclude
+void size_walker_filtered(const char *path, size_t *acc);
+#define SELF_ORBIS_MAGIC 0x1D3D154F
+#define SELF_PROSPERO_MAGIC 0xEEF51454
+int  is_self_name(const char *name);   // extension decrypt_all() looks at
+int  is_self_file(const char *path);   // ... and a SELF magic
+void selfpager_lock(void);            // held while selfpager swaps the vnode pager:
+void selfpager_unlock(void);          // take it around every other file-backed mmap
 void *progress_status_func(void *arg);
 
 extern size_t folder_size_current;
@@ -63,19 +72,34 @@ extern time_t copy_start_time;
 extern int copy_directory(const char *src, const char *dst);
 extern pthread_t progress_thread;
 
-int  find_usb_and_setup(void);
+int  find_usb_and_setup(uint64_t required_bytes);
 int  read_decrypter_config(void);
 int  read_logging_config(void); 
 int  read_elf2fself_config(void);
 int  read_backport_config(void);
 int  read_split_config(void);          // NEW: 0-3 split mode
+int  read_pfs_threads_config(void);    // 1-16 PFS extraction workers
+int  read_pfs_backend_config(void);    // 0 = pread, 1 = mmap
+int  read_pfs_benchmark_config(void);  // 1 = time PFS backends
+int  read_pfs_source_config(void);     // 0 = auto, 1 = image, 2 = sandbox
+int  read_verify_pkg_config(void);     // 1 = check package digests
+int  read_decrypt_threads_config(void); // 1-8 SELF decryption workers
 const char* get_usb_homebrew_path(void);
 
 const char* detect_fs_type(const char *mountpoint);
 void debug_list_usbs(void);
+uint64_t get_time_usec(void);
+uint64_t estimate_dir_usage(const char *path);
 
 extern int g_enable_logging;
 extern char g_log_path[512];
 extern int g_split_mode;               // 0-3: split mode
+extern int g_pfs_threads;              // PFS extraction workers
+extern int g_pfs_backend;              // PFS_BACKEND_PREAD / PFS_BACKEND_MMAP
+extern int g_pfs_benchmark;            // 1: log pread vs mmap throughput
+extern int g_pfs_source;               // PLAN_AUTO / PLAN_IMAGE / PLAN_SANDBOX
+extern int g_verify_pkg;               // 1: pkg_verify before dumping
+extern int g_decrypt_threads;          // SELF decryption workers
+extern int g_route_self;               // 1: filtered copy skips SELFs
 
 #endif /* UTILS_H */
\ No newline at end of file
@@ -0,0 +1,405 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/param.h>
+#include <sys/mount.h>
+
+#include "batch.h"
+#include "ps4_dumper.h"
+#include "ps5_dumper.h"
+#include "utils.h"
+
+enum batch_state {
+    BATCH_SKIP,         /* comment, blank or already has a status */
+    BATCH_PENDING,
+    BATCH_COPIED,       /* waiting for the decrypt thread */
+    BATCH_DONE,
+    BATCH_FAILED,
+};
+
+struct batch_item {
+    char     line[256];         /* as read, written back for BATCH_SKIP */
+    char     title_id[16];
+    int      state;
+    int      is_cusa;
+    char     app_folder[32];
+    char     patch_folder[32];  /* "" if no patch */
+    char     reason[64];
+    uint64_t bytes;
+    double   copy_secs;
+    double   decrypt_secs;
+};
+
+struct batch {
+    const char       *sandbox;
+    const char       *usb;
+    int               do_elf2fself;
+    int               do_backport;
+    struct batch_item items[BATCH_MAX_TITLES];
+    int               count;
+
+    /* decrypt hand-off: items[] indices, filled by the copy side */
+    pthread_mutex_t   lock;
+    pthread_cond_t    cond;
+    int               fifo[BATCH_MAX_TITLES];
+    int               head, tail;
+    int               closing;
+};
+
+/* ------------------- Queue File ------------------- */
+static int parse_title(const char *line, char *title, size_t size, const char **rest)
+{
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '#' || *line == ';') return 0;
+
+    /* four letters, five digits */
+    size_t n = 0;
+    while (line[n] && !isspace((unsigned char)line[n])) n++;
+    if (n != 9 || n >= size) return 0;
+    for (int i = 0; i < 4; i++) if (!isupper((unsigned char)line[i])) return 0;
+    for (int i = 4; i < 9; i++) if (!isdigit((unsigned char)line[i])) return 0;
+
+    memcpy(title, line, n);
+    title[n] = '\0';
+    line += n;
+    while (*line == ' ' || *line == '\t') line++;
+    *rest = line;
+    return 1;
+}
+
+static int queue_load(struct batch *b)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", b->usb, BATCH_QUEUE_FILE);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (b->count == BATCH_MAX_TITLES) {
+            write_log(g_log_path, "batch: more than %d lines in %s, rest ignored",
+                      BATCH_MAX_TITLES, path);
+            break;
+        }
+
+        struct batch_item *it = &b->items[b->count++];
+        memset(it, 0, sizeof(*it));
+        snprintf(it->line, sizeof(it->line), "%s", line);
+
+        const char *rest;
+        if (parse_title(line, it->title_id, sizeof(it->title_id), &rest) && !*rest)
+            it->state = BATCH_PENDING;
+        else
+            it->state = BATCH_SKIP;
+    }
+    fclose(f);
+    return 0;
+}
+
+/* caller holds b->lock once the decrypt thread runs */
+static void queue_save(const struct batch *b)
+{
+    char path[512], tmp[520];
+    snprintf(path, sizeof(path), "%s/%s", b->usb, BATCH_QUEUE_FILE);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    for (int i = 0; i < b->count; i++) {
+        const struct batch_item *it = &b->items[i];
+        if (it->state == BATCH_DONE) {
+            char date[32];
+            time_t now = time(NULL);
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&now));
+            fprintf(f, "%s done %s\n", it->title_id, date);
+        } else if (it->state == BATCH_FAILED) {
+            fprintf(f, "%s failed %s\n", it->title_id, it->reason);
+        } else {
+            fprintf(f, "%s\n", it->line);
+        }
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        write_log(g_log_path, "batch: could not update %s", path);
+    }
+}
+
+int batch_pending(const char *usb)
+{
+    struct batch *b = calloc(1, sizeof(*b));
+    if (!b) return 0;
+    b->usb = usb;
+
+    int pending = 0;
+    if (queue_load(b) == 0)
+        for (int i = 0; i < b->count; i++)
+            if (b->items[i].state == BATCH_PENDING) pending++;
+    free(b);
+    return pending;
+}
+
+/* ------------------- Title State ------------------- */
+static void finish(struct batch *b, struct batch_item *it, const char *reason)
+{
+    pthread_mutex_lock(&b->lock);
+    if (reason) {
+        it->state = BATCH_FAILED;
+        if (reason != it->reason)
+            snprintf(it->reason, sizeof(it->reason), "%s", reason);
+        write_log(g_log_path, "batch: %s failed: %s", it->title_id, reason);
+        printf_notification("%s failed: %s", it->title_id, reason);
+    } else {
+        it->state = BATCH_DONE;
+        write_log(g_log_path, "batch: %s done", it->title_id);
+    }
+    queue_save(b);
+    pthread_mutex_unlock(&b->lock);
+}
+
+/* sandbox mount or, for PS4, the installed package; then the USB space.
+   NULL if the title can be dumped, else why not. */
+static const char *resolve(struct batch *b, struct batch_item *it, const struct catalog *cat)
+{
+    char mnt[512];
+    it->is_cusa = strncmp(it->title_id, "CUSA", 4) == 0;
+    if (!it->is_cusa && strncmp(it->title_id, "PPSA", 4) != 0)
+        return "unsupported title id";
+
+    snprintf(it->app_folder, sizeof(it->app_folder), "%s-app0", it->title_id);
+    snprintf(mnt, sizeof(mnt), "%s/%s", b->sandbox, it->app_folder);
+    int mounted = dir_exists(mnt);
+
+    const struct catalog_entry *app = cat ? catalog_find(cat, it->title_id, "app") : NULL;
+    const struct catalog_entry *pat = cat ? catalog_find(cat, it->title_id, "patch") : NULL;
+
+    uint64_t required = 0;
+    if (mounted) {
+        required = app ? app->size : estimate_dir_usage(mnt);
+    } else if (it->is_cusa && app) {
+        required = app->size;
+        write_log(g_log_path, "batch: %s not mounted, dumping from %s", it->title_id, app->path);
+    } else {
+        return "not mounted";
+    }
+
+    if (it->is_cusa) {
+        snprintf(mnt, sizeof(mnt), "%s/%s-patch0", b->sandbox, it->title_id);
+        if (dir_exists(mnt) || pat) {
+            snprintf(it->patch_folder, sizeof(it->patch_folder), "%s-patch0", it->title_id);
+            required += pat ? pat->size : estimate_dir_usage(mnt);
+        }
+    }
+
+    struct statfs sfs;
+    if (statfs(b->usb, &sfs) == 0) {
+        uint64_t avail = (uint64_t)sfs.f_bavail * (uint64_t)sfs.f_bsize;
+        if (required > avail) {
+            snprintf(it->reason, sizeof(it->reason), "needs %.1f GB, %.1f GB free",
+                     required / 1073741824.0, avail / 1073741824.0);
+            return it->reason;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t dump_size(const struct batch *b, const struct batch_item *it)
+{
+    char dst[512];
+    size_t bytes = 0;
+    snprintf(dst, sizeof(dst), "%s/%s", b->usb, it->app_folder);
+    size_walker(dst, &bytes);
+    if (it->patch_folder[0]) {
+        snprintf(dst, sizeof(dst), "%s/%s", b->usb, it->patch_folder);
+        size_walker(dst, &bytes);
+    }
+    return bytes;
+}
+
+/* ------------------- Decrypt Thread ------------------- */
+static void decrypt_item(struct batch *b, struct batch_item *it)
+{
+    uint64_t start = get_time_usec();
+    int err;
+    if (it->is_cusa)
+        err = decrypt_ps4_cusa_app(b->sandbox, it->app_folder, it->patch_folder, b->usb,
+                                   b->do_elf2fself, b->do_backport);
+    else
+        err = decrypt_ps5_ppsa_app(b->sandbox, it->app_folder, b->usb,
+                                   b->do_elf2fself, b->do_backport);
+    it->decrypt_secs = (get_time_usec() - start) / 1e6;
+    finish(b, it, err != 0 ? "decryption failed" : NULL);
+}
+
+static void *decrypt_thread(void *arg)
+{
+    struct batch *b = arg;
+
+    pthread_mutex_lock(&b->lock);
+    for (;;) {
+        while (b->head == b->tail && !b->closing)
+            pthread_cond_wait(&b->cond, &b->lock);
+        if (b->head == b->tail) break;
+
+        /* stays in the fifo while it runs, so the copy side sees it busy */
+        struct batch_item *it = &b->items[b->fifo[b->head]];
+        pthread_mutex_unlock(&b->lock);
+        decrypt_item(b, it);
+        pthread_mutex_lock(&b->lock);
+
+        b->head++;
+        pthread_cond_broadcast(&b->cond);
+    }
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+/* ------------------- Summary ------------------- */
+static void write_summary(const struct batch *b)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", b->usb, BATCH_SUMMARY_FILE);
+    FILE *f = fopen(path, "w");
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-10s %-7s %9s %9s %9s  %s",
+             "title", "status", "GB", "copy s", "decrypt s", "note");
+    if (f) fprintf(f, "%s\n", line);
+    write_log(g_log_path, "batch: %s", line);
+
+    for (int i = 0; i < b->count; i++) {
+        const struct batch_item *it = &b->items[i];
+        if (it->state == BATCH_SKIP || it->state == BATCH_PENDING) continue;
+        snprintf(line, sizeof(line), "%-10s %-7s %9.2f %9.1f %9.1f  %s",
+                 it->title_id, it->state == BATCH_DONE ? "done" : "failed",
+                 it->bytes / 1073741824.0, it->copy_secs, it->decrypt_secs, it->reason);
+        for (size_t len = strlen(line); len && line[len - 1] == ' '; ) line[--len] = '\0';
+        if (f) fprintf(f, "%s\n", line);
+        write_log(g_log_path, "batch: %s", line);
+    }
+    if (f) fclose(f);
+}
+
+/* ------------------- Run ------------------- */
+int batch_run(const char *sandbox, const char *usb, const struct catalog *cat,
+              int do_decrypt, int do_elf2fself, int do_backport)
+{
+    struct batch *b = calloc(1, sizeof(*b));
+    if (!b) return -1;
+    b->sandbox      = sandbox;
+    b->usb          = usb;
+    b->do_elf2fself = do_elf2fself;
+    b->do_backport  = do_backport;
+    if (queue_load(b) != 0) {
+        free(b);
+        return -1;
+    }
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->cond, NULL);
+
+    int total = 0;
+    for (int i = 0; i < b->count; i++)
+        if (b->items[i].state == BATCH_PENDING) total++;
+    write_log(g_log_path, "batch: %d pending titles in %s (decrypt=%d)",
+              total, BATCH_QUEUE_FILE, do_decrypt);
+
+    pthread_t tid;
+    int threaded = do_decrypt && pthread_create(&tid, NULL, decrypt_thread, b) == 0;
+    if (do_decrypt && !threaded)
+        write_log(g_log_path, "batch: no decrypt thread, decrypting inline");
+
+    int n = 0;
+    for (int i = 0; i < b->count; i++) {
+        struct batch_item *it = &b->items[i];
+        if (it->state != BATCH_PENDING) continue;
+        n++;
+
+        const char *err = resolve(b, it, cat);
+        if (err) {
+            finish(b, it, err);
+            continue;
+        }
+
+        /* one title decrypting, at most one more waiting */
+        pthread_mutex_lock(&b->lock);
+        while (b->tail - b->head >= 2)
+            pthread_cond_wait(&b->cond, &b->lock);
+        pthread_mutex_unlock(&b->lock);
+
+        printf_notification("Batch %d/%d: %s", n, total, it->title_id);
+        write_log(g_log_path, "batch: %d/%d %s (app=%s patch=%s)", n, total,
+                  it->title_id, it->app_folder, it->patch_folder[0] ? it->patch_folder : "-");
+
+        uint64_t start = get_time_usec();
+        int ret = it->is_cusa
+            ? dump_ps4_cusa_app(sandbox, it->app_folder, it->patch_folder, usb,
+                                0, do_elf2fself, do_backport)
+            : dump_ps5_ppsa_app(sandbox, it->app_folder, usb,
+                                0, do_elf2fself, do_backport);
+        it->copy_secs = (get_time_usec() - start) / 1e6;
+        it->bytes = dump_size(b, it);
+
+        char eboot[512];
+        snprintf(eboot, sizeof(eboot), "%s/%s/eboot.bin", usb, it->app_folder);
+        if (ret != 0) {
+            finish(b, it, "dump failed");
+            continue;
+        }
+        if (!file_exists(eboot)) {
+            finish(b, it, "no eboot.bin in dump");
+            continue;
+        }
+
+        if (!do_decrypt) {
+            finish(b, it, NULL);
+        } else if (!threaded) {
+            decrypt_item(b, it);
+        } else {
+            pthread_mutex_lock(&b->lock);
+            it->state = BATCH_COPIED;
+            b->fifo[b->tail++] = i;
+            pthread_cond_broadcast(&b->cond);
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+
+    if (threaded) {
+        pthread_mutex_lock(&b->lock);
+        b->closing = 1;
+        pthread_cond_broadcast(&b->cond);
+        pthread_mutex_unlock(&b->lock);
+        pthread_join(tid, NULL);
+    }
+
+    write_summary(b);
+
+    int failed = 0;
+    for (int i = 0; i < b->count; i++)
+        if (b->items[i].state == BATCH_FAILED) failed++;
+    write_log(g_log_path, "batch: %d titles, %d failed", n, failed);
+
+    pthread_cond_destroy(&b->cond);
+    pthread_mutex_destroy(&b->lock);
+    free(b);
+    return failed;
+}
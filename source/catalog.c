@@ -0,0 +1,398 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "catalog.h"
+#include "pkg.h"
+#include "utils.h"
+
+#define APPMETA_DIR     "/system_data/priv/appmeta"
+#define SFO_MAGIC       "\x00PSF"
+#define META_MAX        0x10000     /* appmeta param.json / param.sfo */
+#define CATALOG_LINE    512
+
+static const char *const install_roots[] = { "", "/mnt/ext0", "/mnt/ext1", NULL };
+
+static const struct {
+    const char *kind;
+    const char *dir;
+    const char *pkg;
+} install_kinds[] = {
+    { "app",   "user/app",   "app.pkg"   },
+    { "patch", "user/patch", "patch.pkg" },
+};
+
+/* ------------------- param.sfo / param.json ------------------- */
+static uint32_t rd32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+static uint16_t rd16(const uint8_t *p) { uint16_t v; memcpy(&v, p, 2); return v; }
+
+/* String value of 'key' in a param.sfo image, 0 when found */
+static int sfo_string(const uint8_t *sfo, size_t len, const char *key, char *out, size_t out_size)
+{
+    if (len < 0x14 || memcmp(sfo, SFO_MAGIC, 4) != 0) return -1;
+
+    uint32_t key_table  = rd32(sfo + 0x08);
+    uint32_t data_table = rd32(sfo + 0x0C);
+    uint32_t count      = rd32(sfo + 0x10);
+    if (count > (len - 0x14) / 0x10) return -1;
+
+    size_t klen = strlen(key);
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *e = sfo + 0x14 + i * 0x10;
+        uint64_t koff = (uint64_t)key_table + rd16(e);
+        uint64_t doff = (uint64_t)data_table + rd32(e + 0x0C);
+        uint32_t dlen = rd32(e + 0x04);
+        if (koff + klen + 1 > len || memcmp(sfo + koff, key, klen + 1) != 0) continue;
+        if (rd16(e + 0x02) != 0x0204 || doff + dlen > len) return -1;
+
+        size_t n = 0;
+        while (n < dlen && n + 1 < out_size && sfo[doff + n]) {
+            out[n] = (char)sfo[doff + n];
+            n++;
+        }
+        out[n] = '\0';
+        return 0;
+    }
+    return -1;
+}
+
+/* "key": "value" in a small JSON file, 0 when found */
+static int json_string(const char *json, const char *key, char *out, size_t out_size)
+{
+    char search[64];
+    snprintf(search, sizeof(search), "\"%s\"", key);
+
+    for (const char *p = strstr(json, search); p; p = strstr(p + 1, search)) {
+        p += strlen(search);
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        if (*p != ':') continue;
+        p++;
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        if (*p != '"') continue;
+        p++;
+
+        size_t n = 0;
+        while (p[n] && p[n] != '"' && n + 1 < out_size) {
+            out[n] = p[n];
+            n++;
+        }
+        out[n] = '\0';
+        return 0;
+    }
+    return -1;
+}
+
+/* Whole appmeta file (NUL terminated), its mtime in *mtime */
+static char *read_meta(const char *root, const char *title, const char *name,
+                       size_t *len, int64_t *mtime)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s" APPMETA_DIR "/%s/%s", root, title, name);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    char *buf = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= META_MAX &&
+        (buf = malloc((size_t)st.st_size + 1))) {
+        if (read(fd, buf, (size_t)st.st_size) == st.st_size) {
+            buf[st.st_size] = '\0';
+            *len   = (size_t)st.st_size;
+            *mtime = (int64_t)st.st_mtime;
+        } else {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    close(fd);
+    return buf;
+}
+
+static int64_t meta_mtime(const char *root, const char *title, const char *name)
+{
+    char path[512];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s" APPMETA_DIR "/%s/%s", root, title, name);
+    return stat(path, &st) == 0 ? (int64_t)st.st_mtime : 0;
+}
+
+/* the appmeta file a cached entry was read from has been rewritten */
+static int meta_changed(const char *root, const struct catalog_entry *e)
+{
+    if (!e->meta_mtime) return 0;
+    return meta_mtime(root, e->title_id, "param.json") != e->meta_mtime &&
+           meta_mtime(root, e->title_id, "param.sfo") != e->meta_mtime;
+}
+
+/* ------------------- Package Headers ------------------- */
+static void read_entry(struct catalog_entry *e, const char *root)
+{
+    e->version[0] = '\0';
+    e->content_id[0] = '\0';
+    e->meta_mtime = 0;
+
+    struct pkg_view v;
+    if (pkg_view_open(&v, e->path) != 0) return;
+
+    uint8_t magic[4];
+    int is_cnt = pkg_view_read(&v, magic, sizeof(magic), 0) == 0 &&
+                 magic[0] == 0x7F && magic[1] == 'C' && magic[2] == 'N' && magic[3] == 'T';
+
+    if (is_cnt && pkg_view_load(&v, 0) == 0) {
+        /* PS4: everything is in the package; the header and one small entry */
+        size_t n = 0;
+        while (n < sizeof(v.hdr.content_id) && n + 1 < sizeof(e->content_id) &&
+               v.hdr.content_id[n] >= 0x20 && v.hdr.content_id[n] < 0x7F) {
+            e->content_id[n] = (char)v.hdr.content_id[n];
+            n++;
+        }
+        e->content_id[n] = '\0';
+
+        const struct pkg_entry *sfo = pkg_view_find(&v, 0x1000);
+        uint8_t *buf = sfo && sfo->size <= META_MAX ? malloc(sfo->size ? sfo->size : 1) : NULL;
+        if (buf && pkg_view_read(&v, buf, sfo->size, v.base + sfo->offset) == 0 &&
+            sfo_string(buf, sfo->size, "APP_VER", e->version, sizeof(e->version)) != 0)
+            sfo_string(buf, sfo->size, "VERSION", e->version, sizeof(e->version));
+        free(buf);
+    }
+    pkg_view_close(&v);
+
+    /* PS5, or a PS4 package without a readable param.sfo: appmeta */
+    size_t len;
+    int64_t mtime;
+    char *meta;
+    if (!is_cnt && (meta = read_meta(root, e->title_id, "param.json", &len, &mtime))) {
+        json_string(meta, "contentId", e->content_id, sizeof(e->content_id));
+        json_string(meta, "contentVersion", e->version, sizeof(e->version));
+        e->meta_mtime = mtime;
+        free(meta);
+    } else if (is_cnt && !e->version[0] &&
+               (meta = read_meta(root, e->title_id, "param.sfo", &len, &mtime))) {
+        if (sfo_string((const uint8_t *)meta, len, "APP_VER", e->version, sizeof(e->version)) != 0)
+            sfo_string((const uint8_t *)meta, len, "VERSION", e->version, sizeof(e->version));
+        e->meta_mtime = mtime;
+        free(meta);
+    }
+}
+
+/* ------------------- Cache ------------------- */
+static int key_cmp(const void *a, const void *b)
+{
+    const struct catalog_entry *x = a, *y = b;
+    int c = strcmp(x->title_id, y->title_id);
+    return c ? c : strcmp(x->kind, y->kind);
+}
+
+/* position of the install root in install_roots: internal storage first */
+static int root_rank(const char *path)
+{
+    for (int r = 1; install_roots[r]; r++) {
+        const char *p = strstr(path, install_roots[r]);
+        if (p && strncmp(p + strlen(install_roots[r]), "/user/", 6) == 0) return r;
+    }
+    return 0;
+}
+
+/* a title installed under several roots sorts in install_roots order,
+   so catalog_find always returns the same copy */
+static int entry_cmp(const void *a, const void *b)
+{
+    const struct catalog_entry *x = a, *y = b;
+    int c = key_cmp(a, b);
+    if (c) return c;
+    int rx = root_rank(x->path), ry = root_rank(y->path);
+    return rx != ry ? rx - ry : strcmp(x->path, y->path);
+}
+
+static struct catalog_entry *catalog_add(struct catalog *cat)
+{
+    if (cat->count == cat->cap) {
+        size_t ncap = cat->cap ? cat->cap * 2 : 64;
+        struct catalog_entry *n = realloc(cat->items, ncap * sizeof(*n));
+        if (!n) return NULL;
+        cat->items = n;
+        cat->cap   = ncap;
+    }
+    struct catalog_entry *e = &cat->items[cat->count++];
+    memset(e, 0, sizeof(*e));
+    return e;
+}
+
+/* tab separated, "-" for an empty field; the path is last */
+static void copy_field(char *dst, size_t size, const char *src)
+{
+    if (strcmp(src, "-") == 0) src = "";
+    strncpy(dst, src, size - 1);
+    dst[size - 1] = '\0';
+}
+
+static void cache_load(struct catalog *cache, const char *cache_dir)
+{
+    char path[512], line[CATALOG_LINE];
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, CATALOG_FILE);
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char *field[8], *save = NULL;
+        int n = 0;
+        for (char *t = strtok_r(line, "\t", &save); t && n < 8; t = strtok_r(NULL, "\t", &save))
+            field[n++] = t;
+        if (n != 8) continue;
+
+        struct catalog_entry *e = catalog_add(cache);
+        if (!e) break;
+        copy_field(e->title_id,   sizeof(e->title_id),   field[0]);
+        copy_field(e->kind,       sizeof(e->kind),       field[1]);
+        copy_field(e->version,    sizeof(e->version),    field[2]);
+        copy_field(e->content_id, sizeof(e->content_id), field[3]);
+        e->size       = strtoull(field[4], NULL, 10);
+        e->mtime      = strtoll(field[5], NULL, 10);
+        e->meta_mtime = strtoll(field[6], NULL, 10);
+        copy_field(e->path,       sizeof(e->path),       field[7]);
+    }
+    fclose(f);
+}
+
+static const char *or_dash(const char *s) { return s[0] ? s : "-"; }
+
+static void cache_save(const struct catalog *cat, const char *cache_dir)
+{
+    char path[512], tmp[520];
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, CATALOG_FILE);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fprintf(f, "# title\tkind\tversion\tcontent_id\tsize\tmtime\tmeta_mtime\tpath\n");
+    for (size_t i = 0; i < cat->count; i++) {
+        const struct catalog_entry *e = &cat->items[i];
+        fprintf(f, "%s\t%s\t%s\t%s\t%llu\t%lld\t%lld\t%s\n",
+                e->title_id, e->kind, or_dash(e->version), or_dash(e->content_id),
+                (unsigned long long)e->size, (long long)e->mtime,
+                (long long)e->meta_mtime, e->path);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        write_log(g_log_path, "catalog: could not update %s", path);
+    }
+}
+
+static const struct catalog_entry *cache_match(const struct catalog *cache, const char *path)
+{
+    for (size_t i = 0; i < cache->count; i++)
+        if (strcmp(cache->items[i].path, path) == 0) return &cache->items[i];
+    return NULL;
+}
+
+/* ------------------- Scan ------------------- */
+int catalog_scan(struct catalog *cat, const char *root, const char *cache_dir)
+{
+    memset(cat, 0, sizeof(*cat));
+    if (!root) root = "";
+
+    struct catalog cache = {0};
+    if (cache_dir) cache_load(&cache, cache_dir);
+
+    uint64_t start = get_time_usec();
+    for (int r = 0; install_roots[r]; r++) {
+        for (size_t k = 0; k < sizeof(install_kinds) / sizeof(install_kinds[0]); k++) {
+            char dir[512];
+            snprintf(dir, sizeof(dir), "%s%s/%s", root, install_roots[r], install_kinds[k].dir);
+            DIR *d = opendir(dir);
+            if (!d) continue;
+
+            struct dirent *dp;
+            while ((dp = readdir(d))) {
+                if (dp->d_name[0] == '.' || strlen(dp->d_name) >= sizeof(cat->items->title_id))
+                    continue;
+
+                char pkg[512];
+                struct stat st;
+                if (snprintf(pkg, sizeof(pkg), "%s/%s/%s", dir, dp->d_name,
+                             install_kinds[k].pkg) >= (int)sizeof(cat->items->path) ||
+                    stat(pkg, &st) != 0 || !S_ISREG(st.st_mode))
+                    continue;
+
+                struct catalog_entry *e = catalog_add(cat);
+                if (!e) break;
+
+                /* unchanged package and appmeta: keep the cached line */
+                const struct catalog_entry *old = cache_match(&cache, pkg);
+                if (old && old->size == (uint64_t)st.st_size && old->mtime == (int64_t)st.st_mtime &&
+                    !meta_changed(root, old)) {
+                    *e = *old;
+                    continue;
+                }
+
+                /* both lengths were checked above */
+                memcpy(e->title_id, dp->d_name, strlen(dp->d_name) + 1);
+                strncpy(e->kind, install_kinds[k].kind, sizeof(e->kind) - 1);
+                memcpy(e->path, pkg, strlen(pkg) + 1);
+                e->size  = (uint64_t)st.st_size;
+                e->mtime = (int64_t)st.st_mtime;
+                read_entry(e, root);
+                cat->refreshed++;
+            }
+            closedir(d);
+        }
+    }
+
+    qsort(cat->items, cat->count, sizeof(*cat->items), entry_cmp);
+    for (size_t i = 1; i < cat->count; i++)
+        if (key_cmp(&cat->items[i - 1], &cat->items[i]) == 0)
+            write_log(g_log_path, "catalog: %s %s is installed more than once, lookups skip %s",
+                      cat->items[i].title_id, cat->items[i].kind, cat->items[i].path);
+    if (cache_dir && (cat->refreshed || cat->count != cache.count)) cache_save(cat, cache_dir);
+    free(cache.items);
+
+    write_log(g_log_path, "catalog: %zu packages (%zu read, %zu cached) in %.1f ms",
+              cat->count, cat->refreshed, cat->count - cat->refreshed,
+              (get_time_usec() - start) / 1000.0);
+    return 0;
+}
+
+const struct catalog_entry *catalog_find(const struct catalog *cat,
+                                         const char *title_id, const char *kind)
+{
+    struct catalog_entry key;
+    memset(&key, 0, sizeof(key));
+    strncpy(key.title_id, title_id, sizeof(key.title_id) - 1);
+    strncpy(key.kind, kind, sizeof(key.kind) - 1);
+
+    /* first of equal keys: the preferred install root */
+    const struct catalog_entry *e = cat->count ?
+        bsearch(&key, cat->items, cat->count, sizeof(key), key_cmp) : NULL;
+    while (e && e > cat->items && key_cmp(e - 1, &key) == 0) e--;
+    return e;
+}
+
+void catalog_free(struct catalog *cat)
+{
+    free(cat->items);
+    memset(cat, 0, sizeof(*cat));
+}
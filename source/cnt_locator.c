@@ -0,0 +1,475 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "cnt_locator.h"
+#include "pkg.h"
+#include "utils.h"
+
+#define SCAN_BUF_SIZE (4 * 1024 * 1024)            // 4MB Chunk Size
+#define FAST_TAIL_SIZE (500ULL * 1024 * 1024)      // 500MB Fallback Scan Window
+#define CNT_SCAN_THREADS 4                         // tail scan workers
+
+#define JSON_MAX_DEPTH  32
+#define JSON_TOKEN_MAX  256     /* longer strings keep their tail */
+#define JSON_CHUNK      0x1000
+#define CACHE_LINE_MAX  256
+
+/* ------------------- Magic Search ------------------- */
+/*
+ * Offset of the first 'magic' in buf, or -1. The vector paths compare the
+ * first and last magic byte for a whole register at once and only memcmp
+ * the middle for candidate positions; the tail is finished with memchr.
+ */
+static ssize_t scan_magic(const uint8_t *buf, size_t len, const uint8_t *magic, size_t mlen)
+{
+    if (mlen < 2 || len < mlen) return -1;
+    size_t last = mlen - 1, i = 0;
+
+#if defined(__AVX2__)
+    const __m256i first = _mm256_set1_epi8((char)magic[0]);
+    const __m256i tail  = _mm256_set1_epi8((char)magic[last]);
+    for (; i + last + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(buf + i + last));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, tail)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + __builtin_ctz(mask);
+            if (memcmp(buf + at + 1, magic + 1, mlen - 2) == 0) return (ssize_t)at;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8((char)magic[0]);
+    const __m128i tail  = _mm_set1_epi8((char)magic[last]);
+    for (; i + last + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(buf + i + last));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, tail)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + __builtin_ctz(mask);
+            if (memcmp(buf + at + 1, magic + 1, mlen - 2) == 0) return (ssize_t)at;
+        }
+    }
+#endif
+
+    while (i + mlen <= len) {
+        const uint8_t *p = memchr(buf + i, magic[0], len - last - i);
+        if (!p) break;
+        if (memcmp(p, magic, mlen) == 0) return p - buf;
+        i = (size_t)(p - buf) + 1;
+    }
+    return -1;
+}
+
+/* ------------------- Fallback Tail Scan for the CNT Header ------------------- */
+static const uint8_t cnt_magic[] = { 0x7F, 0x43, 0x4E, 0x54, 0x83 };
+
+struct cnt_scan {
+    const struct pkg_view *v;
+    uint64_t from, to;      /* this worker's slice of the window */
+    uint64_t end;           /* file size: reads may run past 'to' by the overlap */
+    uint64_t *best;         /* earliest match so far, shared */
+};
+
+static void *cnt_scan_worker(void *arg)
+{
+    struct cnt_scan *scan = arg;
+    const size_t overlap = sizeof(cnt_magic) - 1;
+    /* a mapped package is searched in place */
+    uint8_t *buf = scan->v->map ? NULL : malloc(SCAN_BUF_SIZE + overlap);
+    if (!scan->v->map && !buf) return NULL;
+
+    for (uint64_t pos = scan->from; pos < scan->to; pos += SCAN_BUF_SIZE) {
+        /* an earlier slice already matched: nothing here can win */
+        if (pos >= __atomic_load_n(scan->best, __ATOMIC_RELAXED)) break;
+
+        uint64_t want = scan->to - pos < SCAN_BUF_SIZE ? scan->to - pos : SCAN_BUF_SIZE;
+        want += overlap;    /* a magic straddling the slice end is ours */
+        if (want > scan->end - pos) want = scan->end - pos;
+
+        const uint8_t *p = pkg_view_ptr(scan->v, pos, want);
+        ssize_t got = (ssize_t)want;
+        if (!p) {
+            if (!buf) break;
+            got = pread(scan->v->fd, buf, (size_t)want, (off_t)pos);
+            p = buf;
+        }
+        if (got < (ssize_t)sizeof(cnt_magic)) break;
+
+        ssize_t at = scan_magic(p, (size_t)got, cnt_magic, sizeof(cnt_magic));
+        if (at >= 0) {
+            uint64_t found = pos + (uint64_t)at;
+            uint64_t cur = __atomic_load_n(scan->best, __ATOMIC_RELAXED);
+            while (found < cur &&
+                   !__atomic_compare_exchange_n(scan->best, &cur, found, 1,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+            break;
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/* Scan the package tail for the CNT header, one slice per thread */
+static uint64_t find_cnt_start_fallback(const struct pkg_view *v)
+{
+    uint64_t file_size = v->file_size;
+    if (file_size == 0) return UINT64_MAX;
+
+    uint64_t file_offset = 0;
+    if (file_size > FAST_TAIL_SIZE) {
+        file_offset = file_size - FAST_TAIL_SIZE;
+    }
+
+    uint64_t window = file_size - file_offset;
+    int nthreads = CNT_SCAN_THREADS;
+    if (window / SCAN_BUF_SIZE < (uint64_t)nthreads) nthreads = (int)(window / SCAN_BUF_SIZE);
+    if (nthreads < 1) nthreads = 1;
+
+    /* slices are whole multiples of the read size, the last takes the rest */
+    uint64_t slice = (window / nthreads + SCAN_BUF_SIZE - 1) / SCAN_BUF_SIZE * SCAN_BUF_SIZE;
+    uint64_t best = UINT64_MAX;
+    uint64_t start = get_time_usec();
+
+    struct cnt_scan scans[CNT_SCAN_THREADS];
+    pthread_t threads[CNT_SCAN_THREADS];
+    int started[CNT_SCAN_THREADS] = {0};
+
+    for (int t = 0; t < nthreads; t++) {
+        uint64_t from = file_offset + slice * t;
+        scans[t].v    = v;
+        scans[t].from = from < file_size ? from : file_size;
+        scans[t].to   = (t == nthreads - 1 || from + slice > file_size) ? file_size : from + slice;
+        scans[t].end  = file_size;
+        scans[t].best = &best;
+        /* slice 0 runs here: it holds the earliest candidates */
+        if (t > 0)
+            started[t] = pthread_create(&threads[t], NULL, cnt_scan_worker, &scans[t]) == 0;
+    }
+    cnt_scan_worker(&scans[0]);
+    for (int t = 1; t < nthreads; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+        else cnt_scan_worker(&scans[t]);
+    }
+
+    write_log(g_log_path, "CNT scan: %s at 0x%llX in %.1f ms (%llu MB window, %d threads, %s)",
+              best == UINT64_MAX ? "not found" : "found", (unsigned long long)best,
+              (get_time_usec() - start) / 1000.0,
+              (unsigned long long)(window >> 20), nthreads, v->map ? "mapped" : "pread");
+    return best;
+}
+
+/* ------------------- Streaming app.json Reader ------------------- */
+/*
+ * Just enough JSON to find, in any object, a string value ending in the
+ * wanted piece name together with that object's fileOffset / fileSize.
+ * The file is fed in small chunks, so its size does not matter.
+ */
+struct json_frame {
+    char     is_object;
+    char     expect_key;
+    char     matched;       /* a string value ends in the piece name */
+    char     has_offset;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct json_scan {
+    struct json_frame stack[JSON_MAX_DEPTH];
+    int         depth;
+    int         too_deep;   /* frames past JSON_MAX_DEPTH, not tracked */
+    char        key[32];
+    char        tok[JSON_TOKEN_MAX];
+    size_t      tok_len;
+    int         in_string, escape, in_literal;
+    const char *want;
+    int         found;
+    uint64_t    offset, size;
+};
+
+static void json_append(struct json_scan *js, char c)
+{
+    if (js->tok_len == JSON_TOKEN_MAX - 1) {
+        size_t keep = JSON_TOKEN_MAX / 2;
+        memmove(js->tok, js->tok + js->tok_len - keep, keep);
+        js->tok_len = keep;
+    }
+    js->tok[js->tok_len++] = c;
+}
+
+static struct json_frame *json_top(struct json_scan *js)
+{
+    return js->depth && !js->too_deep ? &js->stack[js->depth - 1] : NULL;
+}
+
+static void json_string_done(struct json_scan *js)
+{
+    struct json_frame *f = json_top(js);
+    js->tok[js->tok_len] = '\0';
+    if (!f) return;
+
+    if (f->is_object && f->expect_key) {
+        strncpy(js->key, js->tok, sizeof(js->key) - 1);
+        js->key[sizeof(js->key) - 1] = '\0';
+        f->expect_key = 0;
+        return;
+    }
+
+    size_t want_len = strlen(js->want);
+    if (js->tok_len >= want_len && strcmp(js->tok + js->tok_len - want_len, js->want) == 0)
+        f->matched = 1;
+}
+
+static void json_literal_done(struct json_scan *js)
+{
+    struct json_frame *f = json_top(js);
+    js->tok[js->tok_len] = '\0';
+    js->in_literal = 0;
+    if (!f || !f->is_object || f->expect_key) return;
+
+    if (strcmp(js->key, "fileOffset") == 0) {
+        f->offset = strtoull(js->tok, NULL, 10);
+        f->has_offset = 1;
+    } else if (strcmp(js->key, "fileSize") == 0) {
+        f->size = strtoull(js->tok, NULL, 10);
+    }
+}
+
+static void json_feed(struct json_scan *js, const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len && !js->found; i++) {
+        char c = buf[i];
+
+        if (js->in_string) {
+            if (js->escape) { js->escape = 0; json_append(js, c); }
+            else if (c == '\\') js->escape = 1;
+            else if (c == '"') { js->in_string = 0; json_string_done(js); }
+            else json_append(js, c);
+            continue;
+        }
+        if (js->in_literal) {
+            if (!strchr(",}] \t\r\n:", c)) { json_append(js, c); continue; }
+            json_literal_done(js);
+        }
+
+        struct json_frame *f;
+        switch (c) {
+        case '"':
+            js->in_string = 1;
+            js->tok_len = 0;
+            break;
+        case '{':
+        case '[':
+            if (js->too_deep || js->depth == JSON_MAX_DEPTH) { js->too_deep++; break; }
+            f = &js->stack[js->depth++];
+            memset(f, 0, sizeof(*f));
+            f->is_object  = c == '{';
+            f->expect_key = f->is_object;
+            break;
+        case '}':
+        case ']':
+            if (js->too_deep) { js->too_deep--; break; }
+            if (!js->depth) break;
+            f = &js->stack[--js->depth];
+            if (f->is_object && f->matched && f->has_offset) {
+                js->found  = 1;
+                js->offset = f->offset;
+                js->size   = f->size;
+            }
+            break;
+        case ',':
+            if ((f = json_top(js)) && f->is_object) f->expect_key = 1;
+            break;
+        case ':': case ' ': case '\t': case '\r': case '\n':
+            break;
+        default:
+            js->in_literal = 1;
+            js->tok_len = 0;
+            json_append(js, c);
+            break;
+        }
+    }
+}
+
+static int parse_app_json(const char *json_path, const char *piece,
+                          uint64_t *out_offset, uint64_t *out_size)
+{
+    int fd = open(json_path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct json_scan *js = calloc(1, sizeof(*js));
+    if (!js) { close(fd); return -1; }
+    js->want = piece;
+
+    char buf[JSON_CHUNK];
+    ssize_t r;
+    while (!js->found && (r = read(fd, buf, sizeof(buf))) > 0)
+        json_feed(js, buf, (size_t)r);
+    close(fd);
+
+    int ret = js->found ? 0 : -1;
+    if (js->found) {
+        *out_offset = js->offset;
+        *out_size   = js->size;
+    }
+    free(js);
+    return ret;
+}
+
+/* ------------------- Offset Cache on the USB ------------------- */
+/* one line per title: "<title> <package size> <cnt offset> <cnt size>" */
+static int cache_path(char *out, size_t out_size)
+{
+    const char *usb = get_usb_homebrew_path();
+    if (!usb || !usb[0]) return -1;
+    snprintf(out, out_size, "%s/%s", usb, CNT_CACHE_FILE);
+    return 0;
+}
+
+static int cache_lookup(const char *title, uint64_t pkg_size, uint64_t *offset, uint64_t *size)
+{
+    char path[512], line[CACHE_LINE_MAX], t[64];
+    unsigned long long psz, off, len;
+    if (cache_path(path, sizeof(path)) != 0) return -1;
+
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+
+    int ret = -1;
+    while (ret != 0 && fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%63s %llu %llu %llu", t, &psz, &off, &len) == 4 &&
+            strcmp(t, title) == 0 && psz == pkg_size) {
+            *offset = off;
+            *size   = len;
+            ret = 0;
+        }
+    }
+    fclose(f);
+    return ret;
+}
+
+/* rewrite without the title's old line; temp file + rename */
+static void cache_store(const char *title, uint64_t pkg_size, uint64_t offset, uint64_t size)
+{
+    char path[512], tmp[520], line[CACHE_LINE_MAX], t[64];
+    if (cache_path(path, sizeof(path)) != 0) return;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *out = fopen(tmp, "w");
+    if (!out) return;
+
+    FILE *in = fopen(path, "r");
+    if (in) {
+        while (fgets(line, sizeof(line), in)) {
+            if (sscanf(line, "%63s", t) == 1 && strcmp(t, title) == 0) continue;
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s %llu %llu %llu\n", title, (unsigned long long)pkg_size,
+            (unsigned long long)offset, (unsigned long long)size);
+
+    if (fclose(out) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        write_log(g_log_path, "CNT locator: could not update %s", path);
+    }
+}
+
+/* ------------------- Locator ------------------- */
+static int cnt_at(const struct pkg_view *v, uint64_t offset)
+{
+    uint8_t magic[4];
+    return pkg_view_read(v, magic, sizeof(magic), offset) == 0 &&
+           memcmp(magic, cnt_magic, sizeof(magic)) == 0;
+}
+
+int cnt_locate(const struct pkg_view *v, uint64_t *offset, uint64_t *size)
+{
+    const char *pkgfn = v->path;
+    uint64_t pkg_size = v->file_size;
+
+    /* title id: the directory holding app.pkg */
+    char pkg_dir[512], title[64];
+    strncpy(pkg_dir, pkgfn, sizeof(pkg_dir) - 1);
+    pkg_dir[sizeof(pkg_dir) - 1] = '\0';
+    char *slash = strrchr(pkg_dir, '/');
+    if (slash) *slash = '\0';
+    const char *base = strrchr(pkg_dir, '/');
+    strncpy(title, slash ? (base ? base + 1 : pkg_dir) : pkgfn, sizeof(title) - 1);
+    title[sizeof(title) - 1] = '\0';
+
+    uint64_t start = get_time_usec();
+    uint64_t off = UINT64_MAX, len = 0;
+    const char *how = NULL;
+
+    /* 1. outer header, then the app_sc.pkg piece in app.json */
+    uint32_t magic = 0;
+    if (pkg_view_read(v, &magic, sizeof(magic), 0) == 0 && cnt_at(v, 0)) {
+        off = 0;
+        len = pkg_size;
+        how = "header";
+    } else {
+        if (magic != PS5_PKG_MAGIC)
+            write_log(g_log_path, "CNT locator: unexpected outer magic 0x%08X", magic);
+
+        char json_path[528];
+        snprintf(json_path, sizeof(json_path), "%s/app.json", slash ? pkg_dir : ".");
+        if (parse_app_json(json_path, "app_sc.pkg", &off, &len) == 0) {
+            if (off < pkg_size && cnt_at(v, off)) how = "app.json";
+            else write_log(g_log_path, "CNT locator: %s points at 0x%llX, no CNT there",
+                           json_path, (unsigned long long)off);
+        }
+    }
+
+    /* 2. cached from an earlier dump of the same package */
+    if (!how && cache_lookup(title, pkg_size, &off, &len) == 0 &&
+        off < pkg_size && cnt_at(v, off))
+        how = "cache";
+
+    /* 3. scan */
+    if (!how) {
+        len = 0;
+        off = find_cnt_start_fallback(v);
+        if (off != UINT64_MAX) how = "scan";
+    }
+
+    if (!how) {
+        write_log(g_log_path, "CNT locator: no CNT header in %s", pkgfn);
+        return -1;
+    }
+
+    /* the next dump of this package skips the scan */
+    if (strcmp(how, "scan") == 0) cache_store(title, pkg_size, off, len);
+
+    write_log(g_log_path, "CNT locator: %s -> 0x%llX via %s in %.1f ms",
+              title, (unsigned long long)off, how, (get_time_usec() - start) / 1000.0);
+    *offset = off;
+    *size   = len;
+    return 0;
+}
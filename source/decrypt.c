@@ -25,8 +25,10 @@ along with this program; see the file COPYING. If not, see
 #include <limits.h>
 #include <sys/mman.h>
 #include <sys/elf64.h>
+#include <pthread.h>
 
 #include "utils.h"
+#include "filter.h"
 #include "decrypt.h"
 #include "ps4_backport.h"
 #include "ps5_backport.h"
@@ -39,12 +41,38 @@ along with this program; see the file COPYING. If not, see
 int g_total_files  = 0;
 int g_current_file = 0;
 
+#define DECRYPT_MAX_THREADS 8
+
+/* one SELF candidate, found by the walk and handed to a worker */
+struct decrypt_job {
+    char     in_path[PATH_MAX];
+    char     out_path[PATH_MAX];
+    uint64_t size;
+};
+
+struct decrypt_list {
+    struct decrypt_job *jobs;
+    size_t count;
+    size_t cap;
+};
+
+struct decrypt_pool {
+    struct decrypt_list *list;
+    const char *root_dst;
+    int    do_elf2fself;
+    int    do_backport;
+    int    is_ps4;
+    size_t next;        /* shared, atomic */
+    int    decrypted;   /* shared, atomic */
+};
+
 /*=====================================================================
  *  Forward declarations (updated with is_ps4 parameter)
  *====================================================================*/
-static int count_files_recursive(const char *dir_path);
 static int process_file(const char *input_path, const char *output_path,
                         const char *root_dst, int do_elf2fself, int do_backport, int is_ps4);
+static int collect_files(const char *input_dir, const char *output_dir, const char *rel,
+                         int keep_all, struct decrypt_list *list);
 static int decrypt_and_process_all(const char *input_dir, const char *output_dir,
                                    const char *root_dst, int do_elf2fself, int do_backport, int is_ps4);
 
@@ -54,7 +82,7 @@ static int decrypt_and_process_all(const char *input_dir, const char *output_dir
 int decrypt_all(const char *src_game, const char *dst_game,
                 int do_elf2fself, int do_backport, int is_ps4)
 {
-    g_total_files = count_files_recursive(src_game);
+    g_total_files = 0;
     g_current_file = 0;
 
     int ret = decrypt_and_process_all(src_game, dst_game, dst_game,
@@ -99,39 +127,6 @@ int decrypt_all(const char *src_game, const char *dst_game,
     return ret;
 }
 
-/*=====================================================================
- *  Count ELF files
- *====================================================================*/
-static int count_files_recursive(const char *dir_path)
-{
-    int total = 0;
-    DIR *dir = opendir(dir_path);
-    if (!dir) return 0;
-
-    struct dirent *ent;
-    char full[PATH_MAX];
-
-    while ((ent = readdir(dir)) != NULL) {
-        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
-            continue;
-
-        snprintf(full, sizeof(full), "%s/%s", dir_path, ent->d_name);
-
-        if (ent->d_type == DT_DIR) {
-            total += count_files_recursive(full);
-        } else if (ent->d_type == DT_REG) {
-            const char *ext = strrchr(ent->d_name, '.');
-            if (ext && (!strcasecmp(ext, ".elf") || !strcasecmp(ext, ".self") ||
-                        !strcasecmp(ext, ".prx") || !strcasecmp(ext, ".sprx") ||
-                        !strcasecmp(ext, ".bin"))) {
-                total++;
-            }
-        }
-    }
-    closedir(dir);
-    return total;
-}
-
 /*=====================================================================
  *  Process ONE file: decrypt → copy → backport → fself
  *====================================================================*/
@@ -219,10 +214,11 @@ static int process_file(const char *input_path, const char *output_path,
 }
 
 /*=====================================================================
- *  Walk and process each file in order
+ *  Walk: queue every SELF candidate the include/exclude rules keep
+ *  'rel' is the path below the title root, as for the copy
  *====================================================================*/
-static int decrypt_and_process_all(const char *input_dir, const char *output_dir,
-                                   const char *root_dst, int do_elf2fself, int do_backport, int is_ps4)
+static int collect_files(const char *input_dir, const char *output_dir, const char *rel,
+                         int keep_all, struct decrypt_list *list)
 {
     DIR *dir = opendir(input_dir);
     if (!dir) return -1;
@@ -230,6 +226,7 @@ static int decrypt_and_process_all(const char *input_dir, const char *output_dir
     struct dirent *ent;
     char in_path[PATH_MAX];
     char out_path[PATH_MAX];
+    char sub_rel[PATH_MAX];
 
     while ((ent = readdir(dir)) != NULL) {
         const char *name = ent->d_name;
@@ -237,6 +234,11 @@ static int decrypt_and_process_all(const char *input_dir, const char *output_dir
 
         snprintf(in_path, sizeof(in_path), "%s/%s", input_dir, name);
         snprintf(out_path, sizeof(out_path), "%s/%s", output_dir, name);
+        snprintf(sub_rel, sizeof(sub_rel), "%s%s%s", rel, rel[0] ? "/" : "", name);
+
+        /* excluded files are never written, excluded directories never opened */
+        int keep = filter_check(sub_rel, ent->d_type == DT_DIR, keep_all);
+        if (keep == FILTER_SKIP) continue;
 
         if (ent->d_type == DT_DIR) {
             /* Skip union folders */
@@ -245,28 +247,113 @@ static int decrypt_and_process_all(const char *input_dir, const char *output_dir
                 strncmp(name + 9, "-app0-patch0-union", 18) == 0) {
                 continue;
             }
-            decrypt_and_process_all(in_path, out_path, root_dst, do_elf2fself, do_backport, is_ps4);
+            collect_files(in_path, out_path, sub_rel, keep == FILTER_KEEP_ALL, list);
             continue;
         }
 
-        if (ent->d_type != DT_REG) continue;
+        if (ent->d_type != DT_REG || !is_self_name(name)) continue;
+
+        if (list->count == list->cap) {
+            size_t ncap = list->cap ? list->cap * 2 : 64;
+            struct decrypt_job *nj = realloc(list->jobs, ncap * sizeof(*nj));
+            if (!nj) break;
+            list->jobs = nj;
+            list->cap = ncap;
+        }
+
+        struct decrypt_job *job = &list->jobs[list->count++];
+        struct stat st;
+        memcpy(job->in_path, in_path, sizeof(in_path));
+        memcpy(job->out_path, out_path, sizeof(out_path));
+        job->size = stat(in_path, &st) == 0 ? (uint64_t)st.st_size : 0;
+    }
+
+    closedir(dir);
+    return 0;
+}
 
-        const char *ext = strrchr(name, '.');
-        if (!ext) continue;
-        if (strcasecmp(ext, ".elf") && strcasecmp(ext, ".self") &&
-            strcasecmp(ext, ".prx") && strcasecmp(ext, ".sprx") &&
-            strcasecmp(ext, ".bin")) continue;
+/*=====================================================================
+ *  Worker: take the next file until none are left
+ *====================================================================*/
+static void *decrypt_worker(void *arg)
+{
+    struct decrypt_pool *pool = arg;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (i >= pool->list->count) break;
+        struct decrypt_job *job = &pool->list->jobs[i];
 
         /* PROGRESS */
-        char msg[512];
-        g_current_file++;
-        snprintf(msg, sizeof(msg), "Decrypting %d/%d: %s", g_current_file, g_total_files, name);
-        printf_notification(msg);
+        const char *name = strrchr(job->in_path, '/');
+        name = name ? name + 1 : job->in_path;
+        int current = __atomic_add_fetch(&g_current_file, 1, __ATOMIC_RELAXED);
+        printf_notification("Decrypting %d/%d: %s", current, g_total_files, name);
 
         /* PROCESS FULLY */
-        process_file(in_path, out_path, root_dst, do_elf2fself, do_backport, is_ps4);
+        int res = process_file(job->in_path, job->out_path, pool->root_dst,
+                               pool->do_elf2fself, pool->do_backport, pool->is_ps4);
+        if (res == 0) {
+            __atomic_add_fetch(&pool->decrypted, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* a SELF the copy left to us (g_route_self): keep it, encrypted */
+        if (res != DECRYPT_ERROR_INPUT_NOT_SELF && !file_exists(job->out_path)) {
+            char dir[PATH_MAX];
+            snprintf(dir, sizeof(dir), "%s", job->out_path);
+            char *slash = strrchr(dir, '/');
+            if (slash) {
+                *slash = '\0';
+                mkdirs(dir);
+            }
+            if (fs_copy_file(job->in_path, job->out_path) == 0)
+                write_log(g_log_path, "Not decrypted, copied as is: %s", job->in_path);
+        }
     }
+    return NULL;
+}
 
-    closedir(dir);
+static int job_size_cmp(const void *a, const void *b)
+{
+    const struct decrypt_job *x = a, *y = b;
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    return 0;
+}
+
+/*=====================================================================
+ *  Decrypt every file on g_decrypt_threads workers
+ *  Only the pagerops swap in selfpager.c is serialized; the kernel
+ *  decryption (mlock), the copy out and the writes overlap across files.
+ *====================================================================*/
+static int decrypt_and_process_all(const char *input_dir, const char *output_dir,
+                                   const char *root_dst, int do_elf2fself, int do_backport, int is_ps4)
+{
+    struct decrypt_list list = {0};
+    if (collect_files(input_dir, output_dir, "", 0, &list) != 0) return -1;
+
+    /* biggest first: a late eboot.bin would leave the other workers idle */
+    qsort(list.jobs, list.count, sizeof(*list.jobs), job_size_cmp);
+    g_total_files = (int)list.count;
+
+    int threads = g_decrypt_threads;
+    if (threads < 1) threads = 1;
+    if (threads > DECRYPT_MAX_THREADS) threads = DECRYPT_MAX_THREADS;
+    if ((size_t)threads > list.count) threads = list.count ? (int)list.count : 1;
+
+    struct decrypt_pool pool = { &list, root_dst, do_elf2fself, do_backport, is_ps4, 0, 0 };
+    uint64_t start = get_time_usec();
+
+    pthread_t tids[DECRYPT_MAX_THREADS];
+    int started[DECRYPT_MAX_THREADS] = {0};
+    for (int t = 1; t < threads; t++)
+        started[t] = pthread_create(&tids[t], NULL, decrypt_worker, &pool) == 0;
+    decrypt_worker(&pool);
+    for (int t = 1; t < threads; t++)
+        if (started[t]) pthread_join(tids[t], NULL);
+
+    write_log(g_log_path, "Decrypted %d of %zu files in %.1f s (%d threads)",
+              pool.decrypted, list.count, (get_time_usec() - start) / 1e6, threads);
+    free(list.jobs);
     return 0;
-}
\ No newline at end of file
+}
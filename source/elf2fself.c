@@ -215,7 +215,7 @@ int elf2fself(const char *elf_path, const char *fself_path)
     self_entry_map_t  *entry_map;
     Elf64_Ehdr ehdr;
     Elf64_Phdr phdr;
-    Elf64_Phdr version_seg;
+    Elf64_Phdr version_seg = {0};
     off_t offset;
     int elf_fd;
     int self_fd;
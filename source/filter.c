@@ -0,0 +1,125 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+
+#include "filter.h"
+#include "utils.h"
+
+#define FILTER_MAX_RULES  32
+#define FILTER_MAX_LEN    128
+
+static char g_include[FILTER_MAX_RULES][FILTER_MAX_LEN];
+static char g_exclude[FILTER_MAX_RULES][FILTER_MAX_LEN];
+static int  g_include_count = 0;
+static int  g_exclude_count = 0;
+
+/* ----------------------------------------------------------------- */
+/*  config.ini: "include = a, b" / "exclude = c", lines may repeat   */
+/* ----------------------------------------------------------------- */
+static void add_rules(char (*rules)[FILTER_MAX_LEN], int *count, char *list)
+{
+    char *save = NULL;
+    for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        while (isspace((unsigned char)*tok)) tok++;
+        char *end = tok + strlen(tok);
+        while (end > tok && isspace((unsigned char)end[-1])) *--end = '\0';
+        while (*tok == '/') tok++;          /* "/sce_sys" == "sce_sys" */
+        if (*tok == '\0' || *count >= FILTER_MAX_RULES) continue;
+
+        strncpy(rules[*count], tok, FILTER_MAX_LEN - 1);
+        rules[*count][FILTER_MAX_LEN - 1] = '\0';
+        write_log(g_log_path, "Filter: %s %s",
+                  rules == g_include ? "include" : "exclude", rules[*count]);
+        (*count)++;
+    }
+}
+
+int filter_load(void)
+{
+    g_include_count = 0;
+    g_exclude_count = 0;
+
+    const char *usb = get_usb_homebrew_path();
+    if (!usb || usb[0] == '\0') return 0;
+
+    char config_path[256];
+    snprintf(config_path, sizeof(config_path), "%s/config.ini", usb);
+
+    FILE *f = fopen(config_path, "r");
+    if (!f) return 0;
+
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+
+        int is_include = strncmp(p, "include", 7) == 0;
+        int is_exclude = strncmp(p, "exclude", 7) == 0;
+        if (!is_include && !is_exclude) continue;
+
+        p += 7;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p != '=') continue;
+        p++;
+
+        char *comment = strchr(p, ';');
+        if (comment) *comment = '\0';
+
+        if (is_include) add_rules(g_include, &g_include_count, p);
+        else            add_rules(g_exclude, &g_exclude_count, p);
+    }
+    fclose(f);
+
+    return g_include_count + g_exclude_count;
+}
+
+int filter_active(void)
+{
+    return g_include_count + g_exclude_count > 0;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Matching                                                         */
+/* ----------------------------------------------------------------- */
+static int match_any(char (*rules)[FILTER_MAX_LEN], int count, const char *rel_path)
+{
+    const char *name = strrchr(rel_path, '/');
+    name = name ? name + 1 : rel_path;
+
+    for (int i = 0; i < count; ++i) {
+        const char *subject = strchr(rules[i], '/') ? rel_path : name;
+        if (fnmatch(rules[i], subject, 0) == 0) return 1;
+    }
+    return 0;
+}
+
+int filter_check(const char *rel_path, int is_dir, int inherited)
+{
+    while (*rel_path == '/') rel_path++;
+
+    if (match_any(g_exclude, g_exclude_count, rel_path)) return FILTER_SKIP;
+
+    if (g_include_count == 0 || inherited ||
+        match_any(g_include, g_include_count, rel_path))
+        return is_dir ? FILTER_KEEP_ALL : FILTER_KEEP;
+
+    return is_dir ? FILTER_KEEP : FILTER_SKIP;
+}
@@ -22,18 +22,81 @@ along with this program; see the file COPYING. If not, see
 #include "ps4_dumper.h"
 #include "ps5_dumper.h"
 #include "utils.h"
+#include "filter.h"
+#include "catalog.h"
+#include "batch.h"
 
 #define VERSION "1.11"
 #define SANDBOX_PATH "/mnt/sandbox/pfsmnt"
 
+#define USB_POLL_NOTIFY_EVERY 7   /* seconds between "insert USB" notifications */
+
+/* Scan the sandbox for the running app; returns -1 if the sandbox can't be opened */
+static int detect_running_app(char *app_folder, size_t app_size,
+                              char *patch_folder, size_t patch_size,
+                              int *is_cusa)
+{
+    DIR *d = opendir(SANDBOX_PATH);
+    if (!d) return -1;
+
+    struct dirent *dp;
+    while ((dp = readdir(d))) {
+        if (dp->d_type != DT_DIR) continue;
+        size_t len = strlen(dp->d_name);
+        if (len <= 5) continue;
+
+        int is_ppsa = (strncmp(dp->d_name, "PPSA", 4) == 0);
+        *is_cusa = (strncmp(dp->d_name, "CUSA", 4) == 0);
+
+        if ((is_ppsa || *is_cusa) && strcmp(dp->d_name + len - 5, "-app0") == 0) {
+            strncpy(app_folder, dp->d_name, app_size-1);
+
+            if (*is_cusa) {
+                char patch_name[128];
+                snprintf(patch_name, sizeof(patch_name), "%.*s-patch0", (int)(len - 5), dp->d_name);
+                rewinddir(d);
+                struct dirent *dp2;
+                while ((dp2 = readdir(d)) != NULL) {
+                    if (dp2->d_type == DT_DIR && strcmp(dp2->d_name, patch_name) == 0) {
+                        strncpy(patch_folder, patch_name, patch_size-1);
+                        break;
+                    }
+                }
+            }
+            break;
+        }
+    }
+    closedir(d);
+    return 0;
+}
+
 int main(void)
 {
     printf_notification("PS5 App Dumper v%s", VERSION);
 
+    /* Detect running app first so the USB can be picked by free space */
+    char app_folder[128] = {0};
+    char patch_folder[128] = {0};
+    int is_cusa = 0;
+    int sandbox_ok = detect_running_app(app_folder, sizeof(app_folder),
+                                        patch_folder, sizeof(patch_folder), &is_cusa);
+
+    uint64_t required = 0;
+    if (app_folder[0]) {
+        char mnt[256];
+        snprintf(mnt, sizeof(mnt), "%s/%s", SANDBOX_PATH, app_folder);
+        required += estimate_dir_usage(mnt);
+        if (patch_folder[0]) {
+            snprintf(mnt, sizeof(mnt), "%s/%s", SANDBOX_PATH, patch_folder);
+            required += estimate_dir_usage(mnt);
+        }
+    }
+
     /* Wait for USB */
-    while (find_usb_and_setup() == -1) {
-        printf_notification("Please insert USB (exFAT) into any port...");
-        sleep(7);
+    for (int tries = 0; find_usb_and_setup(required) == -1; ++tries) {
+        if (tries % USB_POLL_NOTIFY_EVERY == 0)
+            printf_notification("Please insert USB (exFAT) into any port...");
+        sleep(1);
     }
 	
     const char *usb = get_usb_homebrew_path();
@@ -44,6 +107,13 @@ int main(void)
     int elf2fself = read_elf2fself_config();
     int backport = read_backport_config();
     g_enable_logging = read_logging_config();
+    g_pfs_threads = read_pfs_threads_config();
+    g_pfs_backend = read_pfs_backend_config();
+    g_pfs_benchmark = read_pfs_benchmark_config();
+    g_pfs_source = read_pfs_source_config();
+    g_verify_pkg = read_verify_pkg_config();
+    g_decrypt_threads = read_decrypt_threads_config();
+    filter_load();
 
     char logpath[512];
     snprintf(logpath, sizeof(logpath), "%s/log.txt", usb);
@@ -51,47 +121,41 @@ int main(void)
 
     write_log(logpath, "=== PS5 App Dumper v%s ===", VERSION);
 
-    /* Detect running app */
-    DIR *d = opendir(SANDBOX_PATH);
-    if (!d)
+    if (sandbox_ok != 0)
     {
         write_log(logpath, "ERROR: Failed to open %s", SANDBOX_PATH);
         printf_notification("Failed to open %s", SANDBOX_PATH);
         return 1;
     }
 
-    char app_folder[128] = {0};
-    char patch_folder[128] = {0};
-    int is_cusa = 0;
-
-    struct dirent *dp;
-    while ((dp = readdir(d))) {
-        if (dp->d_type != DT_DIR) continue;
-        size_t len = strlen(dp->d_name);
-        if (len <= 5) continue;
-
-        int is_ppsa = (strncmp(dp->d_name, "PPSA", 4) == 0);
-        is_cusa = (strncmp(dp->d_name, "CUSA", 4) == 0);
-
-        if ((is_ppsa || is_cusa) && strcmp(dp->d_name + len - 5, "-app0") == 0) {
-            strncpy(app_folder, dp->d_name, sizeof(app_folder)-1);
+    /* installed titles: package headers and appmeta only, cached on the USB */
+    struct catalog cat;
+    int have_catalog = catalog_scan(&cat, "", usb) == 0;
+    if (have_catalog) {
+        char title[32];
+        snprintf(title, sizeof(title), "%.*s", (int)strcspn(app_folder, "-"), app_folder);
+        const struct catalog_entry *e = app_folder[0] ? catalog_find(&cat, title, "app") : NULL;
+        if (e)
+            write_log(logpath, "Catalog: %s v%s %s, %.2f GB package",
+                      e->title_id, e->version[0] ? e->version : "?", e->content_id,
+                      e->size / 1073741824.0);
+    }
 
-            if (is_cusa) {
-                char patch_name[128];
-                snprintf(patch_name, sizeof(patch_name), "%.*s-patch0", (int)(len - 5), dp->d_name);
-                rewinddir(d);
-                struct dirent *dp2;
-                while ((dp2 = readdir(d)) != NULL) {
-                    if (dp2->d_type == DT_DIR && strcmp(dp2->d_name, patch_name) == 0) {
-                        strncpy(patch_folder, patch_name, sizeof(patch_folder)-1);
-                        break;
-                    }
-                }
-            }
-            break;
-        }
+    /* titles listed in queue.txt take the place of the running app */
+    int pending = batch_pending(usb);
+    if (pending > 0) {
+        write_log(logpath, "Batch mode: %d titles queued", pending);
+        printf_notification("Batch mode: %d titles queued", pending);
+        int failed = batch_run(SANDBOX_PATH, usb, have_catalog ? &cat : NULL,
+                               decrypt, elf2fself, backport);
+        if (have_catalog) catalog_free(&cat);
+
+        write_log(logpath, "=== PS5 App Dumper v%s finished ===", VERSION);
+        if (failed != 0) printf_notification("Batch done, %d failed (see %s)", failed, BATCH_SUMMARY_FILE);
+        else printf_notification("Batch Complete!");
+        return failed != 0;
     }
-    closedir(d);
+    if (have_catalog) catalog_free(&cat);
 
     if (!app_folder[0])
     {
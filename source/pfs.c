@@ -16,188 +16,1364 @@ along with this program; see the file COPYING. If not, see
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "pfs.h"
+#include "pfsc.h"
+#include "pfs_index.h"
+#include "filter.h"
 #include "utils.h"
 
 #define BUFFER_SIZE   0x100000   /* 1 MB */
+#define INODE_BATCH   0x400000   /* read up to 4 MB of inode blocks per pread */
+#define PFSC_THREADS  4          /* decompression workers */
+#define PFS_WINDOW    0x4000000  /* 64 MB mapped per reader */
+#define PFS_READAHEAD 0x800000   /* WILLNEED this far past the cursor */
+#define PFS_PAGE      0x4000
+#define BENCH_LIMIT   0x40000000 /* 1 GB of file data per backend */
 
 /* ----------------------------------------------------------------- */
-/*  Helper: safe string concatenation                                */
+/*  Path arena: bump allocator for the paths of one traversal        */
 /* ----------------------------------------------------------------- */
-static char *strcat_alloc(const char *a, const char *b)
+#define ARENA_CHUNK   0x10000    /* 64 KB */
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    size_t cap;
+    char   data[];
+};
+
+struct pfs_arena {
+    struct arena_chunk *head;
+};
+
+static char *arena_alloc(struct pfs_arena *a, size_t n)
+{
+    struct arena_chunk *c = a->head;
+    if (!c || c->cap - c->used < n) {
+        size_t cap = n > ARENA_CHUNK ? n : ARENA_CHUNK;
+        c = malloc(sizeof(*c) + cap);
+        if (!c) return NULL;
+        c->next = a->head;
+        c->used = 0;
+        c->cap  = cap;
+        a->head = c;
+    }
+    char *p = c->data + c->used;
+    c->used += n;
+    return p;
+}
+
+/* parent + '/' + name (no separator if either side is empty) */
+static char *arena_join(struct pfs_arena *a, const char *parent,
+                        const char *name, size_t name_len)
 {
-    if (!a) a = "";
-    if (!b) b = "";
-    size_t len_a = strlen(a);
-    size_t len_b = strlen(b);
-    char *out = malloc(len_a + len_b + 2);
+    size_t len_p = strlen(parent);
+    size_t sep   = (len_p && name_len) ? 1 : 0;
+    char *out = arena_alloc(a, len_p + sep + name_len + 1);
     if (!out) return NULL;
-    memcpy(out, a, len_a);
-    if (len_a && len_b) out[len_a] = '/';
-    memcpy(out + len_a + (len_a && len_b ? 1 : 0), b, len_b);
-    out[len_a + (len_a && len_b ? 1 : 0) + len_b] = '\0';
+    memcpy(out, parent, len_p);
+    if (sep) out[len_p] = '/';
+    memcpy(out + len_p + sep, name, name_len);
+    out[len_p + sep + name_len] = '\0';
     return out;
 }
 
+static void arena_free(struct pfs_arena *a)
+{
+    while (a->head) {
+        struct arena_chunk *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
+
 /* ----------------------------------------------------------------- */
-/*  Copy chunk with progress                                         */
+/*  Image views: a mapped window or a pread into the caller's buffer */
 /* ----------------------------------------------------------------- */
-static int copy_chunk(int pfs_fd, uint64_t src_off, const char *dst_path,
-                      uint64_t size, pfs_progress_cb progress)
+static void window_release(struct pfs_window *w)
 {
-    int out_fd = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0777);
-    if (out_fd < 0) return -1;
+    if (w->base) munmap(w->base, w->len);
+    memset(w, 0, sizeof(*w));
+}
+
+/* off is a file offset: windows are page aligned in the file, not the image */
+static int window_map(struct pfs_image *img, struct pfs_window *w, uint64_t off, size_t len)
+{
+    uint64_t end  = img->base + img->size;
+    uint64_t woff = off & ~(uint64_t)(PFS_PAGE - 1);
+    if (woff >= end) return -1;
+
+    size_t wlen = PFS_WINDOW;
+    if (wlen > end - woff) wlen = (size_t)(end - woff);
+    if (off + len > woff + wlen) return -1;
+
+    window_release(w);
+    selfpager_lock();
+    void *p = mmap(NULL, wlen, PROT_READ, MAP_SHARED, img->fd, (off_t)woff);
+    selfpager_unlock();
+    if (p == MAP_FAILED) {
+        /* first failure switches every reader to pread for the rest of the run */
+        if (__atomic_exchange_n(&img->backend, PFS_BACKEND_PREAD, __ATOMIC_RELAXED) == PFS_BACKEND_MMAP)
+            write_log(g_log_path, "unpfs: mmap failed at 0x%llx, falling back to pread",
+                      (unsigned long long)woff);
+        return -1;
+    }
+
+    w->base    = p;
+    w->off     = woff;
+    w->len     = wlen;
+    w->advised = woff;
+    w->dropped = woff;
+    madvise(w->base, w->len, MADV_SEQUENTIAL);
+    return 0;
+}
+
+/* Read 'len' bytes at image offset 'off'; the image may start inside a file */
+int pfs_read(const struct pfs_image *img, void *buf, size_t len, uint64_t off)
+{
+    if (off > img->size || len > img->size - off) return -1;
+    return pread(img->fd, buf, len, (off_t)(img->base + off)) == (ssize_t)len ? 0 : -1;
+}
+
+/*
+ * Return 'len' bytes at image offset 'off'. With the mmap backend this is
+ * a pointer into the reader's window (no copy); otherwise, or if mapping
+ * fails, the bytes are read into 'scratch'.
+ */
+static const uint8_t *img_view(struct pfs_image *img, struct pfs_window *w,
+                               uint64_t off, size_t len, uint8_t *scratch)
+{
+    if (off > img->size || len > img->size - off) return NULL;
+
+    uint64_t foff = img->base + off;
+    if (w && len <= PFS_WINDOW &&
+        __atomic_load_n(&img->backend, __ATOMIC_RELAXED) == PFS_BACKEND_MMAP) {
+        if (w->base && foff >= w->off && foff + len <= w->off + w->len)
+            return w->base + (foff - w->off);
+        if (window_map(img, w, foff, len) == 0)
+            return w->base + (foff - w->off);
+    }
+
+    if (!scratch) return NULL;
+    if (pfs_read(img, scratch, len, off) != 0) return NULL;
+    return scratch;
+}
+
+/* Streaming hints: prefetch ahead of the cursor, drop what was written */
+static void window_advise(const struct pfs_image *img, struct pfs_window *w, uint64_t cursor)
+{
+    cursor += img->base;
+    if (!w->base || cursor <= w->off || cursor > w->off + w->len) return;
+
+    uint64_t end  = w->off + w->len;
+    uint64_t want = cursor + PFS_READAHEAD < end ? cursor + PFS_READAHEAD : end;
+    if (want > w->advised) {
+        uint64_t from = w->advised > cursor ? w->advised : cursor;
+        from &= ~(uint64_t)(PFS_PAGE - 1);
+        madvise(w->base + (from - w->off), (size_t)(want - from), MADV_WILLNEED);
+        w->advised = want;
+    }
+
+    uint64_t behind = cursor & ~(uint64_t)(PFS_PAGE - 1);
+    if (behind > w->dropped) {
+        madvise(w->base + (w->dropped - w->off), (size_t)(behind - w->dropped), MADV_DONTNEED);
+        w->dropped = behind;
+    }
+}
+
+/* ----------------------------------------------------------------- */
+/*  Bulk inode table load: one pread per batch of inode blocks       */
+/* ----------------------------------------------------------------- */
+static int has_extra_ptrs(const struct di_d32 *di)
+{
+    for (int k = 1; k < PFS_NDADDR; ++k) if (di->db[k]) return 1;
+    for (int k = 0; k < PFS_NIADDR; ++k) if (di->ib[k]) return 1;
+    return 0;
+}
+
+static struct pfs_inode *load_inodes(struct pfs_image *img)
+{
+    const struct pfs_header_t *hdr = &img->hdr;
+    size_t inode_count = (size_t)hdr->ndinode;
+    size_t ptr_cap = 0;
+    size_t per_block   = hdr->blocksz / sizeof(struct di_d32);
+    if (inode_count == 0 || per_block == 0) return NULL;
+
+    struct pfs_inode *inodes = calloc(inode_count, sizeof(*inodes));
+    if (!inodes) return NULL;
+
+    uint64_t batch_blocks = INODE_BATCH / hdr->blocksz;
+    if (batch_blocks == 0) batch_blocks = 1;
 
-    char *buf = malloc(BUFFER_SIZE);
-    if (!buf) { close(out_fd); return -1; }
+    uint8_t *buf = malloc(batch_blocks * hdr->blocksz);
+    if (!buf) { free(inodes); return NULL; }
 
-    uint64_t copied = 0;
-    while (size) {
-        size_t chunk = (size > BUFFER_SIZE) ? BUFFER_SIZE : (size_t)size;
-        if (lseek(pfs_fd, src_off + copied, SEEK_SET) < 0) break;
-        if (read(pfs_fd, buf, chunk) != (ssize_t)chunk) break;
-        if (write(out_fd, buf, chunk) != (ssize_t)chunk) break;
+    struct pfs_window win = {0};
+    uint64_t start = get_time_usec();
+    size_t ix = 0;
+
+    for (uint64_t i = 0; i < hdr->ndinodeblock && ix < inode_count; i += batch_blocks) {
+        uint64_t n = hdr->ndinodeblock - i;
+        if (n > batch_blocks) n = batch_blocks;
+
+        size_t len = (size_t)(n * hdr->blocksz);
+        off_t  off = (off_t)hdr->blocksz * (i + 1);
+        const uint8_t *data = img_view(img, &win, (uint64_t)off, len, buf);
+        if (!data) {
+            window_release(&win);
+            free(buf);
+            free(inodes);
+            return NULL;
+        }
 
-        copied += chunk;
-        size   -= chunk;
+        for (uint64_t b = 0; b < n; ++b) {
+            const uint8_t *blk = data + b * hdr->blocksz;
+            for (size_t j = 0; j < per_block && ix < inode_count; ++j, ++ix) {
+                struct di_d32 di;
+                memcpy(&di, blk + j * sizeof(di), sizeof(di));
+                inodes[ix].size   = di.size;
+                inodes[ix].db0    = di.db[0];
+                inodes[ix].blocks = di.blocks;
+                inodes[ix].mode   = di.mode;
+                inodes[ix].flags  = di.flags;
+                inodes[ix].size_compressed = di.size_compressed;
+                inodes[ix].ptrs   = PFS_NO_PTRS;
 
-        // === PROGRESS UPDATE ===
-        total_bytes_copied += chunk;
-        if (progress) {
-            strncpy(current_copied, dst_path, sizeof(current_copied) - 1);
-            current_copied[sizeof(current_copied) - 1] = '\0';
-            progress(total_bytes_copied, folder_size_current, current_copied);
+                /* keep the pointer set only for inodes that use more than db[0] */
+                if (has_extra_ptrs(&di)) {
+                    if (img->block_ptr_count == ptr_cap) {
+                        size_t ncap = ptr_cap ? ptr_cap * 2 : 64;
+                        uint32_t *np = realloc(img->block_ptrs, ncap * PFS_INODE_PTRS * sizeof(*np));
+                        if (!np) { window_release(&win); free(buf); free(inodes); return NULL; }
+                        img->block_ptrs = np;
+                        ptr_cap = ncap;
+                    }
+                    uint32_t *dst = &img->block_ptrs[img->block_ptr_count * PFS_INODE_PTRS];
+                    memcpy(dst, di.db, sizeof(di.db));
+                    memcpy(dst + PFS_NDADDR, di.ib, sizeof(di.ib));
+                    inodes[ix].ptrs = (uint32_t)img->block_ptr_count++;
+                }
+            }
         }
     }
 
+    window_release(&win);
     free(buf);
-    close(out_fd);
-    return (size == 0) ? 0 : -1;
+
+    write_log(g_log_path, "unpfs: loaded %zu inodes (%zu with block maps) from %llu blocks in %.2f ms",
+              ix, img->block_ptr_count, (unsigned long long)hdr->ndinodeblock,
+              (double)(get_time_usec() - start) / 1000.0);
+    return inodes;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Growable arrays                                                  */
+/* ----------------------------------------------------------------- */
+static struct pfs_node *tree_add_node(struct pfs_tree *tree, size_t *cap)
+{
+    if (tree->node_count == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 256;
+        struct pfs_node *n = realloc(tree->nodes, ncap * sizeof(*n));
+        if (!n) return NULL;
+        tree->nodes = n;
+        *cap = ncap;
+    }
+    struct pfs_node *node = &tree->nodes[tree->node_count++];
+    memset(node, 0, sizeof(*node));
+    return node;
+}
+
+/* Append an extent, merging with the previous one if it is adjacent.
+ * Extents before index 'floor' belong to another file and are never merged. */
+static int extent_push(struct pfs_extent **v, size_t *n, size_t *cap, size_t floor,
+                       uint64_t offset, uint64_t length)
+{
+    if (*n > floor) {
+        struct pfs_extent *last = &(*v)[*n - 1];
+        if (last->offset + last->length == offset) {
+            last->length += length;
+            return 0;
+        }
+    }
+    if (*n == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 256;
+        struct pfs_extent *e = realloc(*v, ncap * sizeof(*e));
+        if (!e) return -1;
+        *v = e;
+        *cap = ncap;
+    }
+    (*v)[*n].offset = offset;
+    (*v)[*n].length = length;
+    (*n)++;
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Extent resolver: db[12] direct, ib[0] single, ib[1] double       */
+/*  indirect. Adjacent blocks are merged into maximal extents. A     */
+/*  zero pointer past db[0] means the image only recorded the first  */
+/*  block, so the run continues contiguously (legacy layout).        */
+/* ----------------------------------------------------------------- */
+struct ptr_block {
+    uint32_t  blk;      /* 0 = nothing cached (block 0 is the header) */
+    uint32_t *data;
+};
+
+static int ptr_block_load(struct pfs_image *img, struct ptr_block *pb, uint32_t blk)
+{
+    if (pb->blk == blk && pb->data) return 0;
+    if (blk == 0 || blk >= img->hdr.nblock) return -1;
+    if (!pb->data && !(pb->data = malloc(img->hdr.blocksz))) return -1;
+    if (pfs_read(img, pb->data, img->hdr.blocksz, (uint64_t)img->hdr.blocksz * blk) != 0)
+        return -1;
+    pb->blk = blk;
+    return 0;
+}
+
+static int resolve_extents(struct pfs_image *img, uint32_t ino, uint64_t length,
+                           struct pfs_extent **v, size_t *n, size_t *cap)
+{
+    const struct pfs_inode *in = &img->inodes[ino];
+    const uint32_t *ptrs = in->ptrs == PFS_NO_PTRS ? NULL
+                         : &img->block_ptrs[(size_t)in->ptrs * PFS_INODE_PTRS];
+    uint64_t bs      = img->hdr.blocksz;
+    uint64_t ppb     = bs / sizeof(uint32_t);
+    uint64_t nblocks = (length + bs - 1) / bs;
+    size_t   floor   = *n;
+    uint64_t prev    = 0;
+    int      ret     = 0;
+
+    struct ptr_block ind = {0}, dbl = {0};
+
+    for (uint64_t i = 0; i < nblocks; ++i) {
+        uint64_t p = 0;
+
+        if (i == 0) {
+            p = in->db0;
+        } else if (ptrs) {
+            if (i < PFS_NDADDR) {
+                p = ptrs[i];
+            } else if (i < PFS_NDADDR + ppb) {
+                uint32_t ib = ptrs[PFS_NDADDR + 0];
+                if (ib && (ret = ptr_block_load(img, &ind, ib)) != 0) break;
+                if (ib) p = ind.data[i - PFS_NDADDR];
+            } else if (i < PFS_NDADDR + ppb + ppb * ppb) {
+                uint64_t rel = i - PFS_NDADDR - ppb;
+                uint32_t ib = ptrs[PFS_NDADDR + 1];
+                if (ib) {
+                    if ((ret = ptr_block_load(img, &dbl, ib)) != 0) break;
+                    uint32_t l1 = dbl.data[rel / ppb];
+                    if (l1 && (ret = ptr_block_load(img, &ind, l1)) != 0) break;
+                    if (l1) p = ind.data[rel % ppb];
+                }
+            } else {
+                ret = -1;   /* triple indirect: larger than any PFS title */
+                break;
+            }
+        }
+
+        if (p == 0 && i > 0) p = prev + 1;
+        if (p == 0 || p >= img->hdr.nblock) { ret = -1; break; }
+
+        uint64_t len = (i == nblocks - 1) ? length - i * bs : bs;
+        if ((ret = extent_push(v, n, cap, floor, p * bs, len)) != 0) break;
+        prev = p;
+    }
+
+    free(ind.data);
+    free(dbl.data);
+    return ret;
+}
+
+/* Read 'len' bytes described by a list of extents into buf */
+static int pread_extents(struct pfs_image *img, const struct pfs_extent *ext,
+                         size_t count, uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+    for (size_t i = 0; i < count && done < len; ++i) {
+        size_t chunk = ext[i].length;
+        if (chunk > len - done) chunk = len - done;
+        if (pfs_read(img, buf + done, chunk, ext[i].offset) != 0)
+            return -1;
+        done += chunk;
+    }
+    return done == len ? 0 : -1;
 }
 
+#define PFS_MAX_DEPTH  32        /* deeper directories are read with pread */
+
+struct tree_ctx {
+    struct pfs_image *img;
+    struct pfs_tree  *tree;
+    size_t            node_cap;
+    size_t            extent_cap;
+    struct pfs_extent *dir_ext;     /* scratch extents for directory reads */
+    size_t            dir_ext_cap;
+    struct pfs_window win[PFS_MAX_DEPTH];  /* per level: parents stay mapped */
+};
+
 /* ----------------------------------------------------------------- */
-/*  Recursive parser with progress                                   */
+/*  Recursive tree builder                                           */
+/*  Each directory is read extent by extent and parsed from memory.  */
 /* ----------------------------------------------------------------- */
-static void parse_dir(int pfs_fd, const struct pfs_header_t *hdr,
-                      const struct di_d32 *inodes,
-                      uint32_t ino, int level,
-                      const char *parent_path,
-                      int dry_run,
-                      pfs_progress_cb progress,
-                      uint64_t *total_size)
+static int build_dir(struct tree_ctx *ctx, uint32_t ino, int level,
+                     uint32_t parent, const char *parent_path, int keep_all)
 {
-    const struct di_d32 *node = &inodes[ino];
+    struct pfs_image *img = ctx->img;
+    struct pfs_tree *tree = ctx->tree;
+    const struct pfs_inode *node = &img->inodes[ino];
+    uint32_t blocksz = img->hdr.blocksz;
+
+    size_t dir_len = (size_t)node->blocks * blocksz;
+    if (dir_len == 0) return 0;
+
+    size_t dir_ext_count = 0;
+    if (resolve_extents(img, ino, dir_len, &ctx->dir_ext, &dir_ext_count,
+                        &ctx->dir_ext_cap) != 0)
+        return -1;
 
+    /* contiguous directories are parsed straight from the mapping */
+    const uint8_t *buf = NULL;
+    uint8_t *owned = NULL;
+    if (dir_ext_count == 1 && level < PFS_MAX_DEPTH)
+        buf = img_view(img, &ctx->win[level], ctx->dir_ext[0].offset, dir_len, NULL);
+    if (!buf) {
+        owned = malloc(dir_len);
+        if (!owned) return -1;
+        if (pread_extents(img, ctx->dir_ext, dir_ext_count, owned, dir_len) != 0) {
+            free(owned);
+            return -1;
+        }
+        buf = owned;
+    }
+
+    /* Dirents never straddle a block; a zero type ends the block */
     for (uint32_t b = 0; b < node->blocks; ++b) {
-        uint32_t db  = node->db[0] + b;
-        uint64_t pos = (uint64_t)hdr->blocksz * db;
-        uint64_t end = pos + node->size;
+        size_t pos = (size_t)b * blocksz;
+        size_t end = pos + blocksz;
 
-        while (pos < end) {
+        while (pos + sizeof(struct dirent_t) <= end) {
             struct dirent_t ent;
-            if (lseek(pfs_fd, pos, SEEK_SET) < 0 ||
-                read(pfs_fd, &ent, sizeof(ent)) != sizeof(ent))
-                return;
-
-            if (ent.type == 0) return;
-
-            char *name = malloc(ent.namelen + 1);
-            if (!name) return;
-            name[ent.namelen] = '\0';
-            if (level > 0) {
-                if (lseek(pfs_fd, pos + sizeof(ent), SEEK_SET) < 0 ||
-                    read(pfs_fd, name, ent.namelen) != ent.namelen) {
-                    free(name);
-                    return;
+            memcpy(&ent, buf + pos, sizeof(ent));
+
+            if (ent.type == 0 || ent.entsize == 0) break;
+            if (ent.entsize < sizeof(ent) || ent.namelen > ent.entsize - sizeof(ent) ||
+                pos + ent.entsize > end || ent.ino >= img->inode_count)
+                break;
+
+            const char *name = (const char *)buf + pos + sizeof(ent);
+            pos += ent.entsize;
+
+            if (ent.type == PFS_NODE_DIR && level == 0) {
+                /* superroot -> uroot: contents land in the image root */
+                if (build_dir(ctx, ent.ino, level + 1, parent, parent_path, keep_all) != 0) {
+                    free(owned);
+                    return -1;
                 }
+                continue;
+            }
+            if (level == 0) continue;   /* flat_path_table etc. */
+            if (ent.type != PFS_NODE_FILE && ent.type != PFS_NODE_DIR) continue;
+
+            char *path = arena_join(tree->arena, parent_path, name, ent.namelen);
+            if (!path) { free(owned); return -1; }
+
+            /* filtered out: no node, no block map, no directory read */
+            int keep = filter_check(path, ent.type == PFS_NODE_DIR, keep_all);
+            if (keep == FILTER_SKIP) continue;
+
+            struct pfs_node *child = tree_add_node(tree, &ctx->node_cap);
+            if (!child) { free(owned); return -1; }
+
+            const struct pfs_inode *ci = &img->inodes[ent.ino];
+            child->path   = path;
+            child->ino    = ent.ino;
+            child->parent = parent;
+            child->type   = (uint8_t)ent.type;
+
+            if (ent.type == PFS_NODE_FILE) {
+                child->size        = ci->size;
+                child->compressed  = (ci->flags & PFS_INODE_COMPRESSED) != 0;
+                child->stored_size = child->compressed ? ci->size_compressed : ci->size;
+                child->extent_first = (uint32_t)tree->extent_count;
+                if (resolve_extents(img, ent.ino, child->stored_size, &tree->extents,
+                                    &tree->extent_count, &ctx->extent_cap) != 0) {
+                    write_log(g_log_path, "unpfs: bad block map for %s (ino %u)", path, ent.ino);
+                    free(owned);
+                    return -1;
+                }
+                child->extent_count = (uint32_t)(tree->extent_count - child->extent_first);
+                tree->total_size += ci->size;
+                tree->file_count++;
+                if (child->compressed) tree->compressed_count++;
             } else {
-                name[0] = '\0';
+                uint32_t idx = (uint32_t)(tree->node_count - 1);
+                tree->dir_count++;
+                if (build_dir(ctx, ent.ino, level + 1, idx, path, keep == FILTER_KEEP_ALL) != 0) {
+                    free(owned);
+                    return -1;
+                }
             }
+        }
+    }
+
+    free(owned);
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Image open/close                                                 */
+/* ----------------------------------------------------------------- */
+int pfs_open(struct pfs_image *img, const char *pfs_path, int backend)
+{
+    return pfs_open_range(img, pfs_path, 0, 0, backend);
+}
+
+/* size 0 = up to the end of the file */
+int pfs_open_range(struct pfs_image *img, const char *pfs_path, uint64_t base,
+                   uint64_t size, int backend)
+{
+    if (!img || !pfs_path) return -1;
+    memset(img, 0, sizeof(*img));
+
+    img->fd = open(pfs_path, O_RDONLY, 0);
+    if (img->fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(img->fd, &st) != 0) {
+        pfs_close(img);
+        return -1;
+    }
+    img->file_size = (uint64_t)st.st_size;
+    img->backend   = backend == PFS_BACKEND_MMAP ? PFS_BACKEND_MMAP : PFS_BACKEND_PREAD;
+    if (base > img->file_size || size > img->file_size - base) {
+        pfs_close(img);
+        return -1;
+    }
+    img->base = base;
+    img->size = size ? size : img->file_size - base;
+
+    if (pfs_read(img, &img->hdr, sizeof(img->hdr), 0) != 0) {
+        pfs_close(img);
+        return -1;
+    }
+
+    /* a range into a PKG may as well be encrypted: insist on the magic */
+    img->inode_count = (size_t)img->hdr.ndinode;
+    if (img->hdr.magic != PFS_MAGIC || img->hdr.blocksz == 0 ||
+        img->hdr.superroot_ino >= img->inode_count) {
+        pfs_close(img);
+        return -1;
+    }
+
+    /* inodes are loaded by pfs_tree_build, an index lookup skips them */
+    return 0;
+}
+
+void pfs_close(struct pfs_image *img)
+{
+    if (!img) return;
+    free(img->inodes);
+    free(img->block_ptrs);
+    img->inodes = NULL;
+    img->block_ptrs = NULL;
+    img->block_ptr_count = 0;
+    if (img->fd >= 0) close(img->fd);
+    img->fd = -1;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Tree API                                                         */
+/* ----------------------------------------------------------------- */
+/* keep_all: ignore the include/exclude rules (lookups inside a container) */
+static int tree_build(struct pfs_image *img, struct pfs_tree *tree, int keep_all)
+{
+    if (!img || !tree) return -1;
+    memset(tree, 0, sizeof(*tree));
+
+    if (!img->inodes) {
+        img->inodes = load_inodes(img);
+        if (!img->inodes) return -1;
+    }
+
+    tree->arena = calloc(1, sizeof(*tree->arena));
+    if (!tree->arena) return -1;
+
+    struct tree_ctx ctx = { .img = img, .tree = tree };
+
+    /* node 0 is the image root */
+    struct pfs_node *root = tree_add_node(tree, &ctx.node_cap);
+    if (!root) { pfs_tree_free(tree); return -1; }
+    root->path = "";
+    root->ino  = (uint32_t)img->hdr.superroot_ino;
+    root->type = PFS_NODE_DIR;
+
+    uint64_t start = get_time_usec();
+    int ret = build_dir(&ctx, (uint32_t)img->hdr.superroot_ino, 0, 0, "", keep_all);
+    for (int i = 0; i < PFS_MAX_DEPTH; ++i) window_release(&ctx.win[i]);
+    free(ctx.dir_ext);
+    if (ret != 0) {
+        pfs_tree_free(tree);
+        return -1;
+    }
+
+    write_log(g_log_path, "unpfs: tree built: %zu files, %zu dirs, %zu extents, %llu bytes in %.2f ms",
+              tree->file_count, tree->dir_count, tree->extent_count,
+              (unsigned long long)tree->total_size,
+              (double)(get_time_usec() - start) / 1000.0);
+    return 0;
+}
+
+int pfs_tree_build(struct pfs_image *img, struct pfs_tree *tree)
+{
+    return tree_build(img, tree, 0);
+}
+
+void pfs_tree_free(struct pfs_tree *tree)
+{
+    if (!tree) return;
+    free(tree->nodes);
+    free(tree->extents);
+    if (tree->arena) {
+        arena_free(tree->arena);
+        free(tree->arena);
+    }
+    free(tree->path_blob);
+    memset(tree, 0, sizeof(*tree));
+}
+
+const struct pfs_node *pfs_tree_find(const struct pfs_tree *tree, const char *path)
+{
+    if (!tree || !path) return NULL;
+    while (*path == '/') path++;
+    for (size_t i = 0; i < tree->node_count; ++i) {
+        if (strcmp(tree->nodes[i].path, path) == 0) return &tree->nodes[i];
+    }
+    return NULL;
+}
 
-            char *full_path = strcat_alloc(parent_path, name);
-            free(name);
-            if (!full_path) return;
+/*
+ * Mark the nodes to extract: PFS_SELECT_ALL for listed files and for
+ * everything below listed directories, PFS_SELECT_DIR for the parent
+ * directories that must exist. Returns the number of selected files.
+ */
+size_t pfs_tree_select(const struct pfs_tree *tree, const char *const *paths,
+                       size_t npaths, uint8_t *select, uint64_t *bytes)
+{
+    size_t files = 0;
+    if (bytes) *bytes = 0;
+    if (!tree || !select) return 0;
+    memset(select, 0, tree->node_count);
+
+    for (size_t i = 1; i < tree->node_count; ++i) {
+        const struct pfs_node *node = &tree->nodes[i];
 
-            if (ent.type == 2 && level > 0) {
-                if (dry_run) {
-                    *total_size += inodes[ent.ino].size;
-                } else {
-                    uint64_t off = (uint64_t)hdr->blocksz * inodes[ent.ino].db[0];
-                    copy_chunk(pfs_fd, off, full_path, inodes[ent.ino].size, progress);
+        if (node->parent && select[node->parent] == PFS_SELECT_ALL) {
+            select[i] = PFS_SELECT_ALL;
+        } else {
+            for (size_t p = 0; p < npaths; ++p) {
+                const char *want = paths[p];
+                while (*want == '/') want++;
+                if (*want == '\0' || strcmp(node->path, want) == 0) {
+                    select[i] = PFS_SELECT_ALL;
+                    break;
                 }
-            } else if (ent.type == 3) {
-                if (!dry_run) mkdir(full_path, 0777);
-                parse_dir(pfs_fd, hdr, inodes, ent.ino, level + 1,
-                          full_path, dry_run, progress, total_size);
             }
+        }
+        if (select[i] != PFS_SELECT_ALL) continue;
 
-            free(full_path);
-            pos += ent.entsize;
+        for (uint32_t up = node->parent; up && !select[up]; up = tree->nodes[up].parent)
+            select[up] = PFS_SELECT_DIR;
+        if (node->type != PFS_NODE_FILE) continue;
+
+        files++;
+        if (bytes) *bytes += node->size;
+    }
+    return files;
+}
+
+#define SELECT_WALK  3      /* walked directory, nothing below it selected yet */
+
+static int node_is_self(struct pfs_image *img, const struct pfs_tree *tree,
+                        const struct pfs_node *node);
+
+/*
+ * Same marks from the include/exclude rules. A directory the rules only
+ * walk becomes PFS_SELECT_DIR once something below it is selected, so
+ * include-only rules do not recreate the whole directory tree. With
+ * g_route_self and an image, SELFs are left unmarked: decrypt_all()
+ * writes them from the sandbox.
+ */
+size_t pfs_tree_filter(struct pfs_image *img, const struct pfs_tree *tree,
+                       uint8_t *select, uint64_t *bytes)
+{
+    size_t files = 0, selfs = 0;
+    if (bytes) *bytes = 0;
+    if (!tree || !select) return 0;
+    memset(select, 0, tree->node_count);
+
+    for (size_t i = 1; i < tree->node_count; ++i) {
+        const struct pfs_node *node = &tree->nodes[i];
+
+        /* children of a skipped directory stay unmarked: pruned */
+        if (node->parent && !select[node->parent]) continue;
+
+        int keep = filter_check(node->path, node->type == PFS_NODE_DIR,
+                                node->parent && select[node->parent] == PFS_SELECT_ALL);
+        if (keep == FILTER_SKIP) continue;
+
+        if (node->type == PFS_NODE_DIR && keep == FILTER_KEEP) {
+            select[i] = SELECT_WALK;
+            continue;
         }
+        if (node->type == PFS_NODE_FILE && g_route_self && img && node_is_self(img, tree, node)) {
+            selfs++;
+            continue;
+        }
+        select[i] = PFS_SELECT_ALL;
+        for (uint32_t up = node->parent; up && select[up] == SELECT_WALK;
+             up = tree->nodes[up].parent)
+            select[up] = PFS_SELECT_DIR;
+        if (node->type != PFS_NODE_FILE) continue;
+
+        files++;
+        if (bytes) *bytes += node->size;
     }
+
+    for (size_t i = 1; i < tree->node_count; ++i)
+        if (select[i] == SELECT_WALK) select[i] = 0;
+    if (selfs)
+        write_log(g_log_path, "unpfs: %zu SELFs left to the decrypter", selfs);
+    return files;
 }
 
 /* ----------------------------------------------------------------- */
-/*  Public entry point – with progress                               */
+/*  Read a file's stored bytes at a logical offset across extents    */
 /* ----------------------------------------------------------------- */
-int unpfs(const char *pfs_path, const char *out_dir, pfs_progress_cb progress)
+struct node_reader {
+    struct pfs_image      *img;
+    const struct pfs_tree *tree;
+    const struct pfs_node *node;
+};
+
+static int node_read(void *ctx, uint64_t off, void *buf, size_t len)
 {
-    if (!pfs_path || !out_dir) return -1;
+    struct node_reader *r = ctx;
+    const struct pfs_extent *ext = &r->tree->extents[r->node->extent_first];
+    uint8_t *out = buf;
+
+    for (uint32_t x = 0; x < r->node->extent_count && len; ++x) {
+        if (off >= ext[x].length) {
+            off -= ext[x].length;
+            continue;
+        }
+        size_t chunk = (size_t)(ext[x].length - off);
+        if (chunk > len) chunk = len;
+        if (pfs_read(r->img, out, chunk, ext[x].offset + off) != 0)
+            return -1;
+        out += chunk;
+        len -= chunk;
+        off  = 0;
+    }
+    return len == 0 ? 0 : -1;
+}
+
+/* SELF-named and starting with a SELF magic, decompressed for PFSC */
+static int node_is_self(struct pfs_image *img, const struct pfs_tree *tree,
+                        const struct pfs_node *node)
+{
+    const char *name = strrchr(node->path, '/');
+    if (!is_self_name(name ? name + 1 : node->path) || node->size < 4) return 0;
+
+    struct node_reader rd = { img, tree, node };
+    uint32_t magic = 0;
+    int ok = node->compressed && pfsc_is_compressed(node_read, &rd, node->stored_size) ?
+             pfsc_read_head(node_read, &rd, node->stored_size, &magic, sizeof(magic)) == 0 :
+             node_read(&rd, 0, &magic, sizeof(magic)) == 0;
+    return ok && (magic == SELF_ORBIS_MAGIC || magic == SELF_PROSPERO_MAGIC);
+}
+
+int pfs_node_read(struct pfs_image *img, const struct pfs_tree *tree,
+                  const struct pfs_node *node, uint64_t off, void *buf, size_t len)
+{
+    struct node_reader rd = { img, tree, node };
+    return node_read(&rd, off, buf, len);
+}
+
+int pfs_node_inflate(struct pfs_image *img, const struct pfs_tree *tree,
+                     const struct pfs_node *node, int out_fd, uint64_t *written)
+{
+    struct node_reader rd = { img, tree, node };
+    if (!node->compressed || !pfsc_is_compressed(node_read, &rd, node->stored_size))
+        return -1;
+    return pfsc_extract(NULL, node_read, &rd, node->stored_size, out_fd, written);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Shared state of one extraction: files ordered by image offset    */
+/* ----------------------------------------------------------------- */
+#define PFS_MAX_WORKERS  16
+#define COALESCE_FILE    0x40000    /* 256 KB: files up to this size may be merged */
+#define COALESCE_SPAN    0x400000   /* 4 MB: largest merged read */
+
+struct extract_job {
+    uint64_t offset;        /* first stored byte, keeps reads ascending */
+    uint64_t length;        /* bytes of a small contiguous file, 0 = not mergeable */
+    uint32_t node;
+};
+
+/* consecutive jobs served by one read; count == 1 is a plain file copy */
+struct extract_run {
+    uint32_t first;
+    uint32_t count;
+};
+
+struct extract_ctx {
+    struct pfs_image      *img;
+    const struct pfs_tree *tree;
+    const char            *out_dir;
+    struct pfsc_pool      *pool;
+    pfs_progress_cb        progress;
+    pthread_mutex_t        progress_lock;
+    struct extract_job    *jobs;
+    size_t                 njobs;
+    struct extract_run    *runs;
+    size_t                 nruns;
+    size_t                 next;        /* run index, claimed atomically */
+    size_t                 failed;      /* updated atomically */
+};
+
+static int job_cmp(const void *a, const void *b)
+{
+    const struct extract_job *x = a, *y = b;
+    if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+    return x->node < y->node ? -1 : (x->node > y->node);
+}
+
+/* Merge neighbouring small files whose gap is at most one block of padding */
+static size_t plan_runs(const struct pfs_image *img, const struct extract_job *jobs,
+                        size_t njobs, struct extract_run *runs, size_t *merged)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < njobs; ) {
+        size_t j = i + 1;
 
-    int pfs_fd = open(pfs_path, O_RDONLY, 0);
-    if (pfs_fd < 0) return -1;
+        if (jobs[i].length) {
+            uint64_t start = jobs[i].offset;
+            uint64_t end   = start + jobs[i].length;
+            while (j < njobs && jobs[j].length &&
+                   jobs[j].offset >= end &&
+                   jobs[j].offset - end <= img->hdr.blocksz &&
+                   jobs[j].offset + jobs[j].length - start <= COALESCE_SPAN) {
+                end = jobs[j].offset + jobs[j].length;
+                j++;
+            }
+        }
 
-    struct pfs_header_t *hdr = malloc(sizeof(*hdr));
-    if (!hdr) { close(pfs_fd); return -1; }
+        runs[n].first = (uint32_t)i;
+        runs[n].count = (uint32_t)(j - i);
+        if (j - i > 1) *merged += j - i;
+        n++;
+        i = j;
+    }
+    return n;
+}
 
-    if (lseek(pfs_fd, 0, SEEK_SET) < 0 ||
-        read(pfs_fd, hdr, sizeof(*hdr)) != sizeof(*hdr)) {
-        free(hdr); close(pfs_fd); return -1;
+/* progress callbacks are not re-entrant: one worker at a time */
+static void report_progress(struct extract_ctx *ctx, const char *path)
+{
+    if (!ctx->progress) return;
+    pthread_mutex_lock(&ctx->progress_lock);
+    if (path) {
+        strncpy(current_copied, path, sizeof(current_copied) - 1);
+        current_copied[sizeof(current_copied) - 1] = '\0';
     }
+    ctx->progress(__atomic_load_n(&total_bytes_copied, __ATOMIC_RELAXED),
+                  folder_size_current, current_copied);
+    pthread_mutex_unlock(&ctx->progress_lock);
+}
 
-    size_t inode_count = (size_t)hdr->ndinode;
-    struct di_d32 *inodes = calloc(inode_count, sizeof(struct di_d32));
-    if (!inodes) { free(hdr); close(pfs_fd); return -1; }
+/* ----------------------------------------------------------------- */
+/*  Copy one file's extents with progress                            */
+/* ----------------------------------------------------------------- */
+static int copy_file_extents(struct extract_ctx *ctx, const struct pfs_node *node,
+                             const char *dst_path, char *buf, struct pfs_window *win)
+{
+    struct pfs_image *img = ctx->img;
+    const struct pfs_tree *tree = ctx->tree;
+
+    int out_fd = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (out_fd < 0) return -1;
+
+    report_progress(ctx, dst_path);
+
+    /* === PFSC: decompress on the fly, blocks in parallel === */
+    struct node_reader rd = { img, tree, node };
+    if (node->compressed && pfsc_is_compressed(node_read, &rd, node->stored_size)) {
+        uint64_t written = 0;
+        int ret = pfsc_extract(ctx->pool, node_read, &rd, node->stored_size, out_fd, &written);
+        close(out_fd);
+        report_progress(ctx, NULL);
+        if (ret == 0 && written != node->size) ret = -1;
+        return ret;
+    }
+
+    uint64_t left_total = node->size;
+    for (uint32_t x = 0; x < node->extent_count && left_total; ++x) {
+        const struct pfs_extent *e = &tree->extents[node->extent_first + x];
+        uint64_t len  = e->length < left_total ? e->length : left_total;
+        uint64_t done = 0;
+
+        while (done < len) {
+            uint64_t left = len - done;
+            size_t chunk = (left > BUFFER_SIZE) ? BUFFER_SIZE : (size_t)left;
+            const uint8_t *src = img_view(img, win, e->offset + done, chunk, (uint8_t *)buf);
+            if (!src || write(out_fd, src, chunk) != (ssize_t)chunk) {
+                close(out_fd);
+                return -1;
+            }
+            done += chunk;
+            window_advise(img, win, e->offset + done);
 
-    uint32_t ix = 0;
-    for (uint32_t i = 0; i < hdr->ndinodeblock; ++i) {
-        size_t per_block = hdr->blocksz / sizeof(struct di_d32);
-        for (uint32_t j = 0; j < per_block && ix < inode_count; ++j) {
-            uint64_t off = (uint64_t)hdr->blocksz * (i + 1) +
-                           sizeof(struct di_d32) * j;
-            if (lseek(pfs_fd, off, SEEK_SET) < 0 ||
-                read(pfs_fd, &inodes[ix], sizeof(struct di_d32)) != sizeof(struct di_d32))
-                goto cleanup;
-            ++ix;
+            // === PROGRESS UPDATE ===
+            __atomic_add_fetch(&total_bytes_copied, chunk, __ATOMIC_RELAXED);
+            report_progress(ctx, NULL);
         }
+        left_total -= len;
     }
 
-    /* === DRY RUN: calculate total size === */
-    uint64_t total_size = 0;
-    parse_dir(pfs_fd, hdr, inodes, (uint32_t)hdr->superroot_ino,
-              0, out_dir, 1, NULL, &total_size);
+    close(out_fd);
+    if (left_total) {
+        /* the block map ends before the file does */
+        write_log(g_log_path, "unpfs: %s: extents cover %llu of %llu bytes", node->path,
+                  (unsigned long long)(node->size - left_total), (unsigned long long)node->size);
+        return -1;
+    }
+    return 0;
+}
 
-    /* === SET GLOBAL PROGRESS STATE === */
-    folder_size_current = total_size;
+/* ----------------------------------------------------------------- */
+/*  One read for a run of small files, scattered to their outputs    */
+/* ----------------------------------------------------------------- */
+static void copy_run(struct extract_ctx *ctx, const struct extract_run *run, char *buf,
+                     struct pfs_window *win)
+{
+    const struct extract_job *jobs = &ctx->jobs[run->first];
+    const struct extract_job *last = &jobs[run->count - 1];
+    uint64_t start = jobs[0].offset;
+    size_t   span  = (size_t)(last->offset + last->length - start);
+    const uint8_t *data = img_view(ctx->img, win, start, span, (uint8_t *)buf);
+    char     dst[1024];
+
+    for (uint32_t k = 0; k < run->count; ++k) {
+        const struct pfs_node *node = &ctx->tree->nodes[jobs[k].node];
+        snprintf(dst, sizeof(dst), "%s/%s", ctx->out_dir, node->path);
+
+        int ret = -1;
+        if (data) {
+            /* small files are stored whole, the slice is the file */
+            int out_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+            if (out_fd >= 0) {
+                const uint8_t *src = data + (jobs[k].offset - start);
+                if (write(out_fd, src, jobs[k].length) == (ssize_t)jobs[k].length) ret = 0;
+                close(out_fd);
+            }
+            if (ret == 0) {
+                __atomic_add_fetch(&total_bytes_copied, jobs[k].length, __ATOMIC_RELAXED);
+                report_progress(ctx, dst);
+            }
+        } else {
+            /* merged read failed: retry the files one by one */
+            ret = copy_file_extents(ctx, node, dst, buf, win);
+        }
+
+        if (ret != 0) {
+            write_log(g_log_path, "unpfs: failed to extract %s", node->path);
+            __atomic_add_fetch(&ctx->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (data) window_advise(ctx->img, win, start + span);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Worker: claim the next run in offset order until none are left   */
+/* ----------------------------------------------------------------- */
+static void *extract_worker(void *arg)
+{
+    struct extract_ctx *ctx = arg;
+    char dst[1024];
+    struct pfs_window win = {0};
+
+    /* big enough for a merged run and for the 1 MB copy chunks */
+    char *buf = malloc(COALESCE_SPAN > BUFFER_SIZE ? COALESCE_SPAN : BUFFER_SIZE);
+    if (!buf) {
+        write_log(g_log_path, "unpfs: no memory for a worker buffer");
+        return NULL;
+    }
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED);
+        if (i >= ctx->nruns) break;
+
+        const struct extract_run *run = &ctx->runs[i];
+        if (run->count > 1) {
+            copy_run(ctx, run, buf, &win);
+            continue;
+        }
+
+        const struct pfs_node *node = &ctx->tree->nodes[ctx->jobs[run->first].node];
+        snprintf(dst, sizeof(dst), "%s/%s", ctx->out_dir, node->path);
+
+        if (copy_file_extents(ctx, node, dst, buf, &win) != 0) {
+            write_log(g_log_path, "unpfs: failed to extract %s", node->path);
+            __atomic_add_fetch(&ctx->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    window_release(&win);
+    free(buf);
+    return NULL;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Extract a parsed tree: directories first, then files in parallel */
+/* ----------------------------------------------------------------- */
+int pfs_extract(struct pfs_image *img, const struct pfs_tree *tree,
+                const char *out_dir, int threads, pfs_progress_cb progress)
+{
+    return pfs_extract_select(img, tree, out_dir, NULL, threads, progress);
+}
+
+int pfs_extract_select(struct pfs_image *img, const struct pfs_tree *tree,
+                       const char *out_dir, const uint8_t *select,
+                       int threads, pfs_progress_cb progress)
+{
+    if (!img || !tree || !out_dir) return -1;
+    if (threads < 1) threads = 1;
+    if (threads > PFS_MAX_WORKERS) threads = PFS_MAX_WORKERS;
+
+    struct extract_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.img      = img;
+    ctx.tree     = tree;
+    ctx.out_dir  = out_dir;
+    ctx.progress = progress;
+
+    size_t slots = tree->file_count ? tree->file_count : 1;
+    ctx.jobs = malloc(slots * sizeof(*ctx.jobs));
+    ctx.runs = malloc(slots * sizeof(*ctx.runs));
+    if (!ctx.jobs || !ctx.runs) {
+        free(ctx.jobs);
+        free(ctx.runs);
+        return -1;
+    }
+
+    /* pre-order: every parent directory exists before its children */
+    char dst[1024];
+    mkdir(out_dir, 0777);
+    for (size_t i = 1; i < tree->node_count; ++i) {
+        const struct pfs_node *node = &tree->nodes[i];
+        if (select && !select[i]) continue;
+        if (node->type == PFS_NODE_DIR) {
+            snprintf(dst, sizeof(dst), "%s/%s", out_dir, node->path);
+            mkdir(dst, 0777);
+        } else if (ctx.njobs < tree->file_count) {
+            struct extract_job *job = &ctx.jobs[ctx.njobs++];
+            job->offset = node->extent_count ? tree->extents[node->extent_first].offset : 0;
+            job->length = 0;
+            job->node   = (uint32_t)i;
+            if (!node->compressed && node->extent_count == 1 &&
+                node->size && node->size <= COALESCE_FILE &&
+                node->size <= tree->extents[node->extent_first].length)
+                job->length = node->size;
+        }
+    }
+
+    /* walk the image front to back, even with several workers */
+    qsort(ctx.jobs, ctx.njobs, sizeof(*ctx.jobs), job_cmp);
+
+    /* runs of adjacent small files become one multi-MB read */
+    size_t merged = 0;
+    ctx.nruns = plan_runs(img, ctx.jobs, ctx.njobs, ctx.runs, &merged);
+    if (merged)
+        write_log(g_log_path, "unpfs: %zu files in %zu reads (%zu small files coalesced)",
+                  ctx.njobs, ctx.nruns, merged);
+
+    if ((size_t)threads > ctx.nruns) threads = ctx.nruns ? (int)ctx.nruns : 1;
+
+    /* decompression workers only when the image has compressed files */
+    ctx.pool = tree->compressed_count ? pfsc_pool_create(PFSC_THREADS) : NULL;
+    if (tree->compressed_count)
+        write_log(g_log_path, "unpfs: %zu compressed files, %d decompression threads",
+                  tree->compressed_count, ctx.pool ? PFSC_THREADS : 1);
+
+    pthread_mutex_init(&ctx.progress_lock, NULL);
+
+    uint64_t start  = get_time_usec();
+    uint64_t before = __atomic_load_n(&total_bytes_copied, __ATOMIC_RELAXED);
+
+    pthread_t workers[PFS_MAX_WORKERS];
+    int started = 0;
+    for (int t = 1; t < threads; ++t) {
+        if (pthread_create(&workers[started], NULL, extract_worker, &ctx) != 0) break;
+        started++;
+    }
+    extract_worker(&ctx);       /* the caller is worker 0 */
+    for (int t = 0; t < started; ++t)
+        pthread_join(workers[t], NULL);
+
+    /* runs no worker got to (every buffer allocation failed) are failures */
+    for (size_t i = ctx.next; i < ctx.nruns; ++i)
+        ctx.failed += ctx.runs[i].count;
+
+    uint64_t elapsed = get_time_usec() - start;
+    uint64_t bytes   = __atomic_load_n(&total_bytes_copied, __ATOMIC_RELAXED) - before;
+    write_log(g_log_path, "unpfs: extracted %zu files (%.1f MB) in %.2f s with %d workers, %s (%.1f MB/s)",
+              ctx.njobs, bytes / (1024.0 * 1024.0), elapsed / 1e6, started + 1,
+              img->backend == PFS_BACKEND_MMAP ? "mmap" : "pread",
+              elapsed ? (bytes / (1024.0 * 1024.0)) / (elapsed / 1e6) : 0.0);
+
+    pthread_mutex_destroy(&ctx.progress_lock);
+    pfsc_pool_destroy(ctx.pool);
+    free(ctx.runs);
+    free(ctx.jobs);
+    return ctx.failed ? -1 : 0;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Backend benchmark: same file data, pread copies vs mapped views  */
+/* ----------------------------------------------------------------- */
+static volatile uint64_t bench_sink;   /* keeps the page touches alive */
+
+static double bench_backend(struct pfs_image *img, const struct pfs_tree *tree,
+                            int backend, uint64_t limit, uint8_t *buf, uint64_t *bytes)
+{
+    struct pfs_window win = {0};
+    uint64_t sum = 0, done = 0;
+    int saved = img->backend;
+
+    img->backend = backend;
+    uint64_t start = get_time_usec();
+
+    for (size_t x = 0; x < tree->extent_count && done < limit; ++x) {
+        const struct pfs_extent *e = &tree->extents[x];
+        for (uint64_t pos = 0; pos < e->length && done < limit; ) {
+            size_t chunk = e->length - pos > BUFFER_SIZE ? BUFFER_SIZE : (size_t)(e->length - pos);
+            const uint8_t *src = img_view(img, &win, e->offset + pos, chunk, buf);
+            if (!src) break;
+            /* touch every page so mapped data is really faulted in */
+            for (size_t k = 0; k < chunk; k += 0x1000) sum += src[k];
+            pos  += chunk;
+            done += chunk;
+            window_advise(img, &win, e->offset + pos);
+        }
+    }
+
+    double secs = (get_time_usec() - start) / 1e6;
+    window_release(&win);
+    img->backend = saved;
+    bench_sink += sum;
+    *bytes = done;
+    return secs;
+}
+
+void pfs_benchmark(struct pfs_image *img, const struct pfs_tree *tree, uint64_t limit)
+{
+    if (!img || !tree) return;
+    uint8_t *buf = malloc(BUFFER_SIZE);
+    if (!buf) return;
+
+    /* the second pass may hit the page cache: compare on images larger than RAM */
+    static const int backends[2] = { PFS_BACKEND_PREAD, PFS_BACKEND_MMAP };
+    for (int i = 0; i < 2; ++i) {
+        uint64_t bytes = 0;
+        double secs = bench_backend(img, tree, backends[i], limit, buf, &bytes);
+        write_log(g_log_path, "unpfs: benchmark %s: %.1f MB in %.2f s (%.1f MB/s)",
+                  backends[i] == PFS_BACKEND_MMAP ? "mmap" : "pread",
+                  bytes / (1024.0 * 1024.0), secs,
+                  secs > 0 ? (bytes / (1024.0 * 1024.0)) / secs : 0.0);
+    }
+    free(buf);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Open an image and get its tree: cached index first, then parse   */
+/* ----------------------------------------------------------------- */
+int pfs_open_tree(const char *pfs_path, uint64_t base, uint64_t size,
+                  struct pfs_image *img, struct pfs_tree *tree, int *filtered)
+{
+    *filtered = 0;
+    if (pfs_open_range(img, pfs_path, base, size, g_pfs_backend) != 0) return -1;
+
+    /* the index lives next to config.ini; without a USB we always parse */
+    const char *usb = get_usb_homebrew_path();
+    char index_path[512];
+    uint8_t key[PFS_INDEX_KEY_SIZE];
+    int cached = usb && usb[0] != '\0' && pfs_index_key(img, key) == 0;
+    if (cached) {
+        pfs_index_path(key, usb, index_path, sizeof(index_path));
+        if (pfs_index_load(tree, key, index_path) == 0) return 0;
+    }
+
+    if (pfs_tree_build(img, tree) != 0) {
+        pfs_close(img);
+        return -1;
+    }
+
+    /* a filtered tree is incomplete: never cache it */
+    *filtered = filter_active();
+    if (cached && !*filtered && pfs_index_save(tree, key, index_path) != 0)
+        write_log(g_log_path, "unpfs: could not save index %s", index_path);
+    return 0;
+}
+
+static void reset_progress(uint64_t total)
+{
+    folder_size_current = total;
     total_bytes_copied = 0;
     copy_start_time = time(NULL);
     current_copied[0] = '\0';
+}
 
-    /* === CREATE ROOT DIR === */
-    mkdir(out_dir, 0777);
+/* ----------------------------------------------------------------- */
+/*  Public entry point – with progress                               */
+/* ----------------------------------------------------------------- */
+int unpfs(const char *pfs_path, const char *out_dir, pfs_progress_cb progress)
+{
+    return unpfs_range(pfs_path, 0, 0, out_dir, progress);
+}
+
+/* Same, for an image stored at [base, base + size) of a larger file */
+int unpfs_range(const char *pfs_path, uint64_t base, uint64_t size,
+                const char *out_dir, pfs_progress_cb progress)
+{
+    if (!pfs_path || !out_dir) return -1;
+
+    struct pfs_image img;
+    struct pfs_tree tree;
+    int filtered;
+    if (pfs_open_tree(pfs_path, base, size, &img, &tree, &filtered) != 0) return -1;
 
-    /* === REAL EXTRACTION WITH PROGRESS === */
-    parse_dir(pfs_fd, hdr, inodes, (uint32_t)hdr->superroot_ino,
-              0, out_dir, 0, progress, NULL);
+    /* include/exclude rules: a cached full tree is filtered here, and a
+       filtered build still holds the walked directories nothing was kept in.
+       SELFs routed to the decrypter are neither extracted nor counted. */
+    uint8_t *select = NULL;
+    uint64_t total = tree.total_size;
+    if (filter_active() || g_route_self) {
+        select = malloc(tree.node_count);
+        if (select) {
+            size_t files = pfs_tree_filter(&img, &tree, select, &total);
+            write_log(g_log_path, "unpfs: extracting %zu of %zu files", files, tree.file_count);
+        }
+    }
+
+    /* === SET GLOBAL PROGRESS STATE === */
+    reset_progress(total);
+
+    if (g_pfs_benchmark) pfs_benchmark(&img, &tree, BENCH_LIMIT);
+
+    /* === EXTRACTION WITH PROGRESS === */
+    int ret = pfs_extract_select(&img, &tree, out_dir, select, g_pfs_threads, progress);
+
+    free(select);
+    pfs_tree_free(&tree);
+    pfs_close(&img);
+    return ret;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Subset extraction / listing                                      */
+/* ----------------------------------------------------------------- */
+int unpfs_select(const char *pfs_path, const char *out_dir, const char *const *paths,
+                 size_t npaths, pfs_progress_cb progress)
+{
+    if (!pfs_path || !out_dir || (!paths && npaths)) return -1;
 
-cleanup:
-    free(inodes);
-    free(hdr);
-    close(pfs_fd);
+    struct pfs_image img;
+    struct pfs_tree tree;
+    int filtered;
+    if (pfs_open_tree(pfs_path, 0, 0, &img, &tree, &filtered) != 0) return -1;
+
+    int ret = -1;
+    uint64_t bytes = 0;
+    uint8_t *select = malloc(tree.node_count ? tree.node_count : 1);
+    if (select) {
+        size_t files = pfs_tree_select(&tree, paths, npaths, select, &bytes);
+        write_log(g_log_path, "unpfs: %zu of %zu files selected (%llu bytes)",
+                  files, tree.file_count, (unsigned long long)bytes);
+
+        reset_progress(bytes);
+        ret = files ? pfs_extract_select(&img, &tree, out_dir, select, g_pfs_threads, progress) : -1;
+        free(select);
+    }
+
+    pfs_tree_free(&tree);
+    pfs_close(&img);
+    return ret;
+}
+
+int unpfs_list(const char *pfs_path, FILE *out)
+{
+    if (!pfs_path || !out) return -1;
+
+    struct pfs_image img;
+    struct pfs_tree tree;
+    int filtered;
+    if (pfs_open_tree(pfs_path, 0, 0, &img, &tree, &filtered) != 0) return -1;
+
+    for (size_t i = 1; i < tree.node_count; ++i) {
+        const struct pfs_node *node = &tree.nodes[i];
+        fprintf(out, "%c %12llu %s%s\n", node->type == PFS_NODE_DIR ? 'd' : '-',
+                (unsigned long long)node->size, node->path,
+                node->type == PFS_NODE_DIR ? "/" : "");
+    }
+
+    pfs_tree_free(&tree);
+    pfs_close(&img);
     return 0;
-}
\ No newline at end of file
+}
+
+/* ----------------------------------------------------------------- */
+/*  Nested images: a file stored raw and in one piece inside a PFS   */
+/*  (pfs_image.dat in a fake PKG's outer image) is itself a range.   */
+/* ----------------------------------------------------------------- */
+int pfs_locate_file(const char *pfs_path, uint64_t base, uint64_t size, const char *file,
+                    uint64_t *out_base, uint64_t *out_size)
+{
+    if (!pfs_path || !file || !out_base || !out_size) return -1;
+
+    struct pfs_image img;
+    struct pfs_tree tree;
+    if (pfs_open_range(&img, pfs_path, base, size, PFS_BACKEND_PREAD) != 0) return -1;
+    if (tree_build(&img, &tree, 1) != 0) {
+        pfs_close(&img);
+        return -1;
+    }
+
+    int ret = -1;
+    const struct pfs_node *node = pfs_tree_find(&tree, file);
+    if (!node || node->type != PFS_NODE_FILE) {
+        write_log(g_log_path, "unpfs: %s not found in %s", file, pfs_path);
+    } else if (node->compressed || node->extent_count != 1) {
+        write_log(g_log_path, "unpfs: %s in %s is %s, cannot read it in place", file, pfs_path,
+                  node->compressed ? "compressed" : "fragmented");
+    } else {
+        *out_base = img.base + tree.extents[node->extent_first].offset;
+        *out_size = node->size;
+        ret = 0;
+    }
+
+    pfs_tree_free(&tree);
+    pfs_close(&img);
+    return ret;
+}
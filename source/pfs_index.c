@@ -0,0 +1,274 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pfs_index.h"
+#include "sha256.h"
+#include "utils.h"
+
+#define KEY_BLOCK_MAX   0x10000   /* hash at most 64 KB of each block */
+#define INDEX_MAX_NODES 0x1000000
+
+/* ----------------------------------------------------------------- */
+/*  Image fingerprint                                                */
+/* ----------------------------------------------------------------- */
+int pfs_index_key(struct pfs_image *img, uint8_t key[PFS_INDEX_KEY_SIZE])
+{
+    struct stat st;
+    if (!img || fstat(img->fd, &st) != 0) return -1;
+
+    size_t len = img->hdr.blocksz < KEY_BLOCK_MAX ? img->hdr.blocksz : KEY_BLOCK_MAX;
+    uint8_t *buf = malloc(len);
+    if (!buf) return -1;
+
+    SHA256_CTX sha;
+    sha256_init(&sha);
+
+    /* the range matters too: one PKG file may hold several images */
+    uint64_t meta[4] = { (uint64_t)st.st_size, (uint64_t)st.st_mtime, img->base, img->size };
+    sha256_update(&sha, (const uint8_t *)meta, sizeof(meta));
+
+    /* superblock, then the block holding the superroot's inode */
+    for (int b = 0; b < 2; ++b) {
+        if (pfs_read(img, buf, len, (uint64_t)img->hdr.blocksz * b) != 0) {
+            free(buf);
+            return -1;
+        }
+        sha256_update(&sha, buf, len);
+    }
+
+    sha256_final(&sha, key);
+    free(buf);
+    return 0;
+}
+
+void pfs_index_path(const uint8_t key[PFS_INDEX_KEY_SIZE], const char *dir,
+                    char *out, size_t out_size)
+{
+    char hex[17];
+    for (int i = 0; i < 8; ++i) snprintf(hex + i * 2, 3, "%02x", key[i]);
+    snprintf(out, out_size, "%s/pfs_index/%s.pfsi", dir, hex);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Save                                                             */
+/* ----------------------------------------------------------------- */
+int pfs_index_save(const struct pfs_tree *tree, const uint8_t key[PFS_INDEX_KEY_SIZE],
+                   const char *path)
+{
+    if (!tree || !key || !path || tree->node_count == 0) return -1;
+
+    uint64_t path_bytes = 0;
+    for (size_t i = 0; i < tree->node_count; ++i)
+        path_bytes += strlen(tree->nodes[i].path) + 1;
+    if (path_bytes > UINT32_MAX) return -1;
+
+    size_t node_bytes   = tree->node_count * sizeof(struct pfs_index_node);
+    size_t extent_bytes = tree->extent_count * sizeof(struct pfs_extent);
+    size_t body_size    = node_bytes + extent_bytes + (size_t)path_bytes;
+
+    uint8_t *body = malloc(body_size);
+    if (!body) return -1;
+
+    struct pfs_index_node *rec = (struct pfs_index_node *)body;
+    char *paths = (char *)body + node_bytes + extent_bytes;
+    uint32_t off = 0;
+
+    for (size_t i = 0; i < tree->node_count; ++i) {
+        const struct pfs_node *node = &tree->nodes[i];
+        size_t len = strlen(node->path) + 1;
+
+        memset(&rec[i], 0, sizeof(rec[i]));
+        rec[i].size         = node->size;
+        rec[i].stored_size  = node->stored_size;
+        rec[i].path_off     = off;
+        rec[i].ino          = node->ino;
+        rec[i].parent       = node->parent;
+        rec[i].extent_first = node->extent_first;
+        rec[i].extent_count = node->extent_count;
+        rec[i].type         = node->type;
+        rec[i].compressed   = node->compressed;
+
+        memcpy(paths + off, node->path, len);
+        off += (uint32_t)len;
+    }
+    if (extent_bytes) memcpy(body + node_bytes, tree->extents, extent_bytes);
+
+    struct pfs_index_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic            = PFS_INDEX_MAGIC;
+    hdr.version          = PFS_INDEX_VERSION;
+    hdr.body_size        = body_size;
+    hdr.node_count       = tree->node_count;
+    hdr.extent_count     = tree->extent_count;
+    hdr.path_bytes       = path_bytes;
+    hdr.total_size       = tree->total_size;
+    hdr.file_count       = tree->file_count;
+    hdr.dir_count        = tree->dir_count;
+    hdr.compressed_count = tree->compressed_count;
+    memcpy(hdr.key, key, PFS_INDEX_KEY_SIZE);
+
+    SHA256_CTX sha;
+    sha256_init(&sha);
+    sha256_update(&sha, body, body_size);
+    sha256_final(&sha, hdr.body_sha);
+
+    /* pfs_index/ next to the file */
+    char dir[512];
+    strncpy(dir, path, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    char *slash = strrchr(dir, '/');
+    if (slash) {
+        *slash = '\0';
+        mkdirs(dir);
+    }
+
+    /* write a temp file and rename: a cut-off write never looks valid */
+    char tmp[520];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    int ret = -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (fd >= 0) {
+        if (write(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) &&
+            write(fd, body, body_size) == (ssize_t)body_size)
+            ret = 0;
+        close(fd);
+        if (ret == 0) ret = rename(tmp, path);
+        if (ret != 0) unlink(tmp);
+    }
+
+    free(body);
+    if (ret == 0)
+        write_log(g_log_path, "unpfs: saved index %s (%zu nodes, %zu bytes)",
+                  path, tree->node_count, body_size + sizeof(hdr));
+    return ret;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Load                                                             */
+/* ----------------------------------------------------------------- */
+static int header_ok(const struct pfs_index_header *hdr, const uint8_t *key, uint64_t file_size)
+{
+    if (hdr->magic != PFS_INDEX_MAGIC || hdr->version != PFS_INDEX_VERSION) return 0;
+    if (memcmp(hdr->key, key, PFS_INDEX_KEY_SIZE) != 0) return 0;
+    if (hdr->node_count == 0 || hdr->node_count > INDEX_MAX_NODES) return 0;
+    if (hdr->extent_count > UINT32_MAX || hdr->path_bytes == 0 || hdr->path_bytes > UINT32_MAX) return 0;
+
+    uint64_t expect = hdr->node_count * sizeof(struct pfs_index_node) +
+                      hdr->extent_count * sizeof(struct pfs_extent) + hdr->path_bytes;
+    return hdr->body_size == expect && sizeof(*hdr) + expect == file_size;
+}
+
+int pfs_index_load(struct pfs_tree *tree, const uint8_t key[PFS_INDEX_KEY_SIZE],
+                   const char *path)
+{
+    if (!tree || !key || !path) return -1;
+
+    int fd = open(path, O_RDONLY, 0);
+    if (fd < 0) return -1;
+
+    uint64_t start = get_time_usec();
+    struct stat st;
+    struct pfs_index_header hdr;
+    if (fstat(fd, &st) != 0 ||
+        read(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+        !header_ok(&hdr, key, (uint64_t)st.st_size)) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t *body = malloc((size_t)hdr.body_size);
+    if (!body || read(fd, body, (size_t)hdr.body_size) != (ssize_t)hdr.body_size) {
+        free(body);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    uint8_t digest[PFS_INDEX_KEY_SIZE];
+    SHA256_CTX sha;
+    sha256_init(&sha);
+    sha256_update(&sha, body, (size_t)hdr.body_size);
+    sha256_final(&sha, digest);
+
+    size_t node_bytes   = (size_t)hdr.node_count * sizeof(struct pfs_index_node);
+    size_t extent_bytes = (size_t)hdr.extent_count * sizeof(struct pfs_extent);
+    const struct pfs_index_node *rec = (const struct pfs_index_node *)body;
+    char *paths = (char *)body + node_bytes + extent_bytes;
+
+    struct pfs_tree t;
+    memset(&t, 0, sizeof(t));
+    t.nodes   = malloc((size_t)hdr.node_count * sizeof(*t.nodes));
+    t.extents = malloc(extent_bytes ? extent_bytes : 1);
+
+    int ok = memcmp(digest, hdr.body_sha, sizeof(digest)) == 0 &&
+             paths[hdr.path_bytes - 1] == '\0' && t.nodes && t.extents;
+
+    for (size_t i = 0; ok && i < hdr.node_count; ++i) {
+        struct pfs_index_node r;
+        memcpy(&r, &rec[i], sizeof(r));
+
+        /* pre-order and in-range, or the index is not trusted */
+        if (r.path_off >= hdr.path_bytes || (i && r.parent >= i) ||
+            (uint64_t)r.extent_first + r.extent_count > hdr.extent_count ||
+            (r.type != PFS_NODE_FILE && r.type != PFS_NODE_DIR)) {
+            ok = 0;
+            break;
+        }
+
+        struct pfs_node *node = &t.nodes[i];
+        node->path         = paths + r.path_off;
+        node->size         = r.size;
+        node->stored_size  = r.stored_size;
+        node->ino          = r.ino;
+        node->parent       = r.parent;
+        node->extent_first = r.extent_first;
+        node->extent_count = r.extent_count;
+        node->type         = r.type;
+        node->compressed   = r.compressed;
+    }
+
+    if (!ok) {
+        free(t.nodes);
+        free(t.extents);
+        free(body);
+        write_log(g_log_path, "unpfs: ignoring damaged index %s", path);
+        return -1;
+    }
+
+    if (extent_bytes) memcpy(t.extents, body + node_bytes, extent_bytes);
+    t.node_count       = (size_t)hdr.node_count;
+    t.extent_count     = (size_t)hdr.extent_count;
+    t.total_size       = hdr.total_size;
+    t.file_count       = (size_t)hdr.file_count;
+    t.dir_count        = (size_t)hdr.dir_count;
+    t.compressed_count = (size_t)hdr.compressed_count;
+    t.path_blob        = (char *)body;     /* paths point into the body */
+    *tree = t;
+
+    write_log(g_log_path, "unpfs: loaded index %s: %zu files, %zu dirs in %.2f ms",
+              path, tree->file_count, tree->dir_count,
+              (double)(get_time_usec() - start) / 1000.0);
+    return 0;
+}
@@ -0,0 +1,289 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "pfsc.h"
+#include "utils.h"
+
+#define PFSC_MAX_THREADS     16
+#define PFSC_BLOCKS_PER_JOB  4      /* blocks queued per worker per batch */
+#define PFSC_MAX_BLOCK_SZ    0x100000
+
+/* ----------------------------------------------------------------- */
+/*  Worker pool: one batch of independent blocks at a time           */
+/* ----------------------------------------------------------------- */
+struct pfsc_job {
+    const uint8_t *src;
+    size_t         src_len;
+    uint8_t       *dst;
+    size_t         dst_len;     /* bytes this block must produce */
+    uint32_t       block_sz;
+    int            err;
+};
+
+struct pfsc_pool {
+    pthread_t       threads[PFSC_MAX_THREADS];
+    int             nthreads;
+    pthread_mutex_t run_lock;   /* one pfsc_extract owns the pool at a time */
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cv;
+    pthread_cond_t  done_cv;
+    struct pfsc_job *jobs;
+    int             njobs;
+    int             next;
+    int             done;
+    int             quit;
+};
+
+static void run_job(struct pfsc_job *job)
+{
+    if (job->src_len == 0) {
+        /* sparse block */
+        memset(job->dst, 0, job->dst_len);
+    } else if (job->src_len == job->block_sz) {
+        /* stored uncompressed */
+        memcpy(job->dst, job->src, job->dst_len);
+    } else {
+        uLongf out_len = job->block_sz;
+        if (uncompress(job->dst, &out_len, job->src, job->src_len) != Z_OK ||
+            out_len < job->dst_len)
+            job->err = -1;
+    }
+}
+
+static void *pfsc_worker(void *arg)
+{
+    struct pfsc_pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->next >= pool->njobs)
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+        if (pool->quit) break;
+
+        struct pfsc_job *job = &pool->jobs[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        run_job(job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->done == pool->njobs)
+            pthread_cond_signal(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct pfsc_pool *pfsc_pool_create(int threads)
+{
+    if (threads <= 1) return NULL;
+    if (threads > PFSC_MAX_THREADS) threads = PFSC_MAX_THREADS;
+
+    struct pfsc_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    for (int i = 0; i < threads; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, pfsc_worker, pool) != 0) break;
+        pool->nthreads++;
+    }
+
+    if (pool->nthreads == 0) {
+        pfsc_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void pfsc_pool_destroy(struct pfsc_pool *pool)
+{
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done_cv);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+    free(pool);
+}
+
+static void pool_run(struct pfsc_pool *pool, struct pfsc_job *jobs, int njobs)
+{
+    /* no pool, or another extraction worker already owns it: decompress
+       on the calling thread instead of queueing behind it */
+    if (!pool || pthread_mutex_trylock(&pool->run_lock) != 0) {
+        for (int i = 0; i < njobs; ++i) run_job(&jobs[i]);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->jobs  = jobs;
+    pool->njobs = njobs;
+    pool->next  = 0;
+    pool->done  = 0;
+    pthread_cond_broadcast(&pool->work_cv);
+    while (pool->done < pool->njobs)
+        pthread_cond_wait(&pool->done_cv, &pool->lock);
+    pool->jobs  = NULL;
+    pool->njobs = 0;
+    pool->next  = 0;
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->run_lock);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Stream detection + extraction                                    */
+/* ----------------------------------------------------------------- */
+static int read_header(pfsc_read_fn read, void *ctx, uint64_t stored_size,
+                       struct pfsc_header_t *hdr)
+{
+    if (stored_size < sizeof(*hdr)) return -1;
+    if (read(ctx, 0, hdr, sizeof(*hdr)) != 0) return -1;
+    if (hdr->magic != PFSC_MAGIC) return -1;
+    if (hdr->block_sz == 0 || hdr->block_sz > PFSC_MAX_BLOCK_SZ) return -1;
+    return 0;
+}
+
+int pfsc_is_compressed(pfsc_read_fn read, void *ctx, uint64_t stored_size)
+{
+    struct pfsc_header_t hdr;
+    return read_header(read, ctx, stored_size, &hdr) == 0;
+}
+
+int pfsc_read_head(pfsc_read_fn read, void *ctx, uint64_t stored_size, void *buf, size_t len)
+{
+    struct pfsc_header_t hdr;
+    uint64_t table[2];
+    if (read_header(read, ctx, stored_size, &hdr) != 0 || len > hdr.data_length ||
+        len > hdr.block_sz || hdr.block_offsets + sizeof(table) > stored_size ||
+        read(ctx, hdr.block_offsets, table, sizeof(table)) != 0 ||
+        table[1] < table[0] || table[1] - table[0] > hdr.block_sz || table[1] > stored_size)
+        return -1;
+
+    /* the first block only */
+    uint8_t *cbuf = malloc(hdr.block_sz);
+    uint8_t *obuf = malloc(hdr.block_sz);
+    int ret = -1;
+    if (cbuf && obuf && (table[1] == table[0] ||
+                         read(ctx, table[0], cbuf, (size_t)(table[1] - table[0])) == 0)) {
+        struct pfsc_job job = { cbuf, (size_t)(table[1] - table[0]), obuf,
+                                hdr.data_length < hdr.block_sz ? (size_t)hdr.data_length
+                                                               : hdr.block_sz,
+                                hdr.block_sz, 0 };
+        run_job(&job);
+        if (!job.err) {
+            memcpy(buf, obuf, len);
+            ret = 0;
+        }
+    }
+    free(obuf);
+    free(cbuf);
+    return ret;
+}
+
+int pfsc_extract(struct pfsc_pool *pool, pfsc_read_fn read, void *ctx,
+                 uint64_t stored_size, int out_fd, uint64_t *written)
+{
+    struct pfsc_header_t hdr;
+    if (read_header(read, ctx, stored_size, &hdr) != 0) return -1;
+
+    uint64_t bs      = hdr.block_sz;
+    uint64_t nblocks = (hdr.data_length + bs - 1) / bs;
+    if (written) *written = 0;
+    if (nblocks == 0) return 0;
+
+    size_t table_len = (size_t)(nblocks + 1) * sizeof(uint64_t);
+    if (hdr.block_offsets + table_len > stored_size) return -1;
+
+    uint64_t *table = malloc(table_len);
+    if (!table) return -1;
+    if (read(ctx, hdr.block_offsets, table, table_len) != 0) {
+        free(table);
+        return -1;
+    }
+
+    int batch = pool ? pool->nthreads * PFSC_BLOCKS_PER_JOB : 1;
+    uint8_t *cbuf = malloc((size_t)batch * bs);
+    uint8_t *obuf = malloc((size_t)batch * bs);
+    struct pfsc_job *jobs = calloc(batch, sizeof(*jobs));
+    int ret = (cbuf && obuf && jobs) ? 0 : -1;
+
+    for (uint64_t b0 = 0; ret == 0 && b0 < nblocks; b0 += batch) {
+        uint64_t b1 = b0 + batch;
+        if (b1 > nblocks) b1 = nblocks;
+
+        /* validate the sector map for this batch */
+        for (uint64_t b = b0; b < b1; ++b) {
+            if (table[b + 1] < table[b] || table[b + 1] - table[b] > bs ||
+                table[b + 1] > stored_size) {
+                ret = -1;
+                break;
+            }
+        }
+        if (ret != 0) break;
+
+        /* compressed sectors of a batch are consecutive: one read */
+        size_t clen = (size_t)(table[b1] - table[b0]);
+        if (clen && read(ctx, table[b0], cbuf, clen) != 0) { ret = -1; break; }
+
+        size_t olen = 0;
+        for (uint64_t b = b0; b < b1; ++b) {
+            struct pfsc_job *job = &jobs[b - b0];
+            uint64_t left = hdr.data_length - b * bs;
+            job->src      = cbuf + (table[b] - table[b0]);
+            job->src_len  = (size_t)(table[b + 1] - table[b]);
+            job->dst      = obuf + (b - b0) * bs;
+            job->dst_len  = (size_t)(left < bs ? left : bs);
+            job->block_sz = (uint32_t)bs;
+            job->err      = 0;
+            olen += job->dst_len;
+        }
+
+        pool_run(pool, jobs, (int)(b1 - b0));
+
+        for (uint64_t b = b0; b < b1; ++b) {
+            if (jobs[b - b0].err) { ret = -1; break; }
+        }
+        if (ret != 0) break;
+
+        if (write(out_fd, obuf, olen) != (ssize_t)olen) { ret = -1; break; }
+
+        __atomic_add_fetch(&total_bytes_copied, olen, __ATOMIC_RELAXED);
+        if (written) *written += olen;
+    }
+
+    free(jobs);
+    free(obuf);
+    free(cbuf);
+    free(table);
+    return ret;
+}
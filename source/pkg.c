@@ -0,0 +1,303 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pkg.h"
+#include "utils.h"
+
+#define NAME_TABLE_MAX  (16 * 1024 * 1024)
+
+/* ------------------- Package View ------------------- */
+int pkg_view_open(struct pkg_view *v, const char *path)
+{
+    memset(v, 0, sizeof(*v));
+    v->fd = open(path, O_RDONLY);
+    if (v->fd < 0) {
+        write_log(g_log_path, "pkg: open %s failed (errno: %d)", path, errno);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(v->fd, &st) != 0 || st.st_size <= 0) {
+        close(v->fd);
+        v->fd = -1;
+        return -1;
+    }
+    strncpy(v->path, path, sizeof(v->path) - 1);
+    v->file_size = (uint64_t)st.st_size;
+
+    /* read-only and shared: pages come straight from the file cache */
+    selfpager_lock();
+    void *map = mmap(NULL, (size_t)v->file_size, PROT_READ, MAP_SHARED, v->fd, 0);
+    selfpager_unlock();
+    if (map != MAP_FAILED) v->map = map;
+    else write_log(g_log_path, "pkg: mmap %s failed (errno: %d), using pread", path, errno);
+    return 0;
+}
+
+void pkg_view_close(struct pkg_view *v)
+{
+    if (v->map) munmap((void *)v->map, (size_t)v->file_size);
+    if (v->fd >= 0) close(v->fd);
+    free(v->table_copy);
+    free(v->entries);
+    free(v->decoded);
+    free(v->hash);
+    memset(v, 0, sizeof(*v));
+    v->fd = -1;
+}
+
+const uint8_t *pkg_view_ptr(const struct pkg_view *v, uint64_t off, uint64_t len)
+{
+    if (!v->map || off > v->file_size || len > v->file_size - off) return NULL;
+    return v->map + off;
+}
+
+int pkg_view_read(const struct pkg_view *v, void *buf, size_t len, uint64_t off)
+{
+    if (off > v->file_size || len > v->file_size - off) return -1;
+    if (v->map) {
+        memcpy(buf, v->map + off, len);
+        return 0;
+    }
+    return pread(v->fd, buf, len, (off_t)off) == (ssize_t)len ? 0 : -1;
+}
+
+int pkg_view_load(struct pkg_view *v, uint64_t base)
+{
+    free(v->table_copy);
+    free(v->entries);
+    free(v->decoded);
+    free(v->hash);
+    v->table_copy = NULL;
+    v->entries    = NULL;
+    v->decoded    = NULL;
+    v->hash       = NULL;
+    v->hash_size  = 0;
+    v->table      = NULL;
+    v->entry_count = 0;
+
+    if (pkg_view_read(v, &v->hdr, sizeof(v->hdr), base) != 0) return -1;
+    if (pkg_be32(v->hdr.magic) != PS4_PKG_MAGIC) return -2;
+
+    uint32_t table_offset = pkg_be32(v->hdr.file_table_offset);
+    uint16_t n_entries    = pkg_be16(v->hdr.table_entries_num);
+    uint64_t table_len    = (uint64_t)n_entries * sizeof(struct cnt_pkg_table_entry);
+    if (base + table_offset > v->file_size || table_len > v->file_size - base - table_offset) {
+        write_log(g_log_path, "pkg: table 0x%X (%u entries) past the end of %s",
+                  table_offset, n_entries, v->path);
+        return -3;
+    }
+
+    v->base         = base;
+    v->table_offset = table_offset;
+    v->entries = calloc(n_entries ? n_entries : 1, sizeof(*v->entries));
+    v->decoded = calloc(n_entries ? n_entries : 1, 1);
+    if (!v->entries || !v->decoded) return -4;
+
+    v->table = pkg_view_ptr(v, base + table_offset, table_len);
+    if (!v->table) {
+        v->table_copy = malloc(table_len ? (size_t)table_len : 1);
+        if (!v->table_copy ||
+            pkg_view_read(v, v->table_copy, (size_t)table_len, base + table_offset) != 0)
+            return -5;
+        v->table = v->table_copy;
+    }
+    v->entry_count = n_entries;
+    return 0;
+}
+
+const struct pkg_entry *pkg_view_entry(struct pkg_view *v, uint16_t i)
+{
+    if (i >= v->entry_count) return NULL;
+    if (!v->decoded[i]) {
+        struct cnt_pkg_table_entry raw;
+        memcpy(&raw, v->table + (size_t)i * sizeof(raw), sizeof(raw));
+        v->entries[i].type   = pkg_be32(raw.type);
+        v->entries[i].flags1 = pkg_be32(raw.flags1);
+        v->entries[i].flags2 = pkg_be32(raw.flags2);
+        v->entries[i].offset = pkg_be32(raw.offset);
+        v->entries[i].size   = pkg_be32(raw.size);
+        v->decoded[i] = 1;
+    }
+    return &v->entries[i];
+}
+
+/* type sits in the first word of each raw entry */
+static uint32_t raw_type(const struct pkg_view *v, uint16_t i)
+{
+    uint32_t type;
+    memcpy(&type, v->table + (size_t)i * sizeof(struct cnt_pkg_table_entry), sizeof(type));
+    return pkg_be32(type);
+}
+
+static size_t type_slot(uint32_t type, size_t mask)
+{
+    return (size_t)((type * 2654435761U) >> 7) & mask;
+}
+
+/* first entry of a type; the table is hashed on the first lookup */
+const struct pkg_entry *pkg_view_find(struct pkg_view *v, uint32_t type)
+{
+    if (!v->entry_count) return NULL;
+
+    if (!v->hash) {
+        size_t size = 16;
+        while (size < (size_t)v->entry_count * 2) size <<= 1;
+        v->hash = calloc(size, sizeof(*v->hash));
+        if (!v->hash) {
+            for (uint16_t i = 0; i < v->entry_count; i++)
+                if (raw_type(v, i) == type) return pkg_view_entry(v, i);
+            return NULL;
+        }
+        v->hash_size = size;
+        for (uint16_t i = 0; i < v->entry_count; i++) {
+            uint32_t t = raw_type(v, i);
+            size_t slot = type_slot(t, size - 1);
+            while (v->hash[slot] && raw_type(v, v->hash[slot] - 1) != t)
+                slot = (slot + 1) & (size - 1);
+            if (!v->hash[slot]) v->hash[slot] = (uint16_t)(i + 1);
+        }
+    }
+
+    size_t mask = v->hash_size - 1;
+    for (size_t slot = type_slot(type, mask); v->hash[slot]; slot = (slot + 1) & mask) {
+        if (raw_type(v, v->hash[slot] - 1) == type)
+            return pkg_view_entry(v, v->hash[slot] - 1);
+    }
+    return NULL;
+}
+
+/* ------------------- Name Table ------------------- */
+int pkg_names_load(struct pkg_view *v, struct pkg_names *names)
+{
+    memset(names, 0, sizeof(*names));
+
+    const struct pkg_entry *table = pkg_view_find(v, PS4_PKG_ENTRY_TYPE_NAME_TABLE);
+    if (!table) return 0;
+    if (table->size == 0 || table->size > NAME_TABLE_MAX) return -1;
+
+    /* +1: a table cut short by a bad size still ends in a NUL; the copy
+       is also what the callers rewrite names in */
+    names->pool = malloc((size_t)table->size + 1);
+    if (!names->pool) return -1;
+    if (pkg_view_read(v, names->pool, table->size, v->base + table->offset) != 0) {
+        write_log(g_log_path, "unpkg: failed to read name table (%u bytes)", table->size);
+        pkg_names_free(names);
+        return -1;
+    }
+    names->pool[table->size] = '\0';
+
+    /* byte 0 is the empty root name; an empty name ends the table */
+    size_t cap = 0;
+    for (size_t pos = 1; pos < table->size && names->pool[pos]; ) {
+        if (names->count == cap) {
+            size_t ncap = cap ? cap * 2 : 64;
+            uint32_t *ni = realloc(names->index, ncap * sizeof(*ni));
+            if (!ni) { pkg_names_free(names); return -1; }
+            names->index = ni;
+            cap = ncap;
+        }
+        names->index[names->count++] = (uint32_t)pos;
+        pos += strlen(names->pool + pos) + 1;
+    }
+
+    write_log(g_log_path, "unpkg: name table: %zu names in %u bytes", names->count, table->size);
+    return 0;
+}
+
+void pkg_names_free(struct pkg_names *names)
+{
+    free(names->pool);
+    free(names->index);
+    memset(names, 0, sizeof(*names));
+}
+
+/* ------------------- Entry Extraction ------------------- */
+static int job_cmp(const void *a, const void *b)
+{
+    const struct pkg_job *x = a, *y = b;
+    if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+    return 0;
+}
+
+static int copy_entry(const struct pkg_view *v, uint64_t offset, uint64_t size,
+                      const char *dst, uint8_t **buf)
+{
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0777);
+    if (out == -1) return -1;
+
+    /* mapped: write the entry straight out of the page cache */
+    const uint8_t *src = pkg_view_ptr(v, offset, size);
+    if (!src && !*buf) *buf = malloc(PKG_COPY_BUF);
+
+    uint64_t done = 0;
+    while (done < size && (src || *buf)) {
+        size_t chunk = size - done < PKG_COPY_BUF ? (size_t)(size - done) : PKG_COPY_BUF;
+        const uint8_t *p = src ? src + done : *buf;
+        if (!src && pread(v->fd, *buf, chunk, (off_t)(offset + done)) != (ssize_t)chunk)
+            break;
+        if (pwrite(out, p, chunk, (off_t)done) != (ssize_t)chunk)
+            break;
+        done += chunk;
+    }
+    close(out);
+    return done == size ? 0 : -1;
+}
+
+int pkg_extract_jobs(struct pkg_view *v, struct pkg_job *jobs, size_t njobs,
+                     const char *out_dir)
+{
+    /* only needed when an entry is not reachable through the mapping */
+    uint8_t *buf = NULL;
+
+    qsort(jobs, njobs, sizeof(*jobs), job_cmp);
+
+    int extracted = 0;
+    for (size_t i = 0; i < njobs; i++) {
+        char full[512];
+        if (snprintf(full, sizeof(full), "%s/%s", out_dir, jobs[i].name) >= (int)sizeof(full)) {
+            write_log(g_log_path, "unpkg: path too long, skipping %s", jobs[i].name);
+            continue;
+        }
+
+        char *p = strrchr(full, '/');
+        if (p && p > full + strlen(out_dir)) {
+            *p = '\0';
+            mkdirs(full);
+            *p = '/';
+        }
+
+        if (copy_entry(v, v->base + jobs[i].offset, jobs[i].size, full, &buf) != 0) {
+            write_log(g_log_path, "unpkg: failed to extract %s", jobs[i].name);
+            continue;
+        }
+        extracted++;
+        write_log(g_log_path, "unpkg: Extracted %s (%llu bytes)", jobs[i].name,
+                  (unsigned long long)jobs[i].size);
+    }
+
+    free(buf);
+    return extracted;
+}
@@ -0,0 +1,318 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pkg_verify.h"
+#include "sha256.h"
+#include "utils.h"
+
+#define VERIFY_MAX_THREADS  16
+#define VERIFY_BUF          0x100000
+#define ENTRY_ENCRYPTED     0x80000000U     /* flags1: digest is of the plaintext */
+
+/* ------------------- Regions ------------------- */
+struct verify_range {
+    uint64_t offset;        /* file offset */
+    uint64_t size;
+};
+
+struct verify_region {
+    char     what[32];
+    uint64_t offset;        /* file offset */
+    uint64_t size;          /* total, for ordering */
+    struct verify_range *ranges;    /* hashed in order; NULL = [offset, offset + size) */
+    size_t   nranges;
+    uint8_t  expect[SHA256_BLOCK_SIZE];
+    int      per_entry;     /* slot of the digest table, not a header digest */
+    int      is_table;      /* the digest table itself */
+    int      is_body;
+    int      main_entries;  /* main_entries1/2: layout inferred, see pkg_verify() */
+    int      result;        /* 0 match, 1 mismatch, -1 unreadable */
+};
+
+struct verify_pool {
+    struct pkg_view      *v;
+    struct verify_region *regions;
+    size_t                count;
+    size_t                next;     /* shared, atomic */
+};
+
+static int hash_range(const struct pkg_view *v, uint64_t offset, uint64_t size,
+                      uint8_t **buf, SHA256_CTX *sha)
+{
+    /* mapped: hash in place, no copy */
+    const uint8_t *src = pkg_view_ptr(v, offset, size);
+    if (src) {
+        sha256_update(sha, src, (size_t)size);
+        return 0;
+    }
+
+    if (!*buf && !(*buf = malloc(VERIFY_BUF))) return -1;
+    for (uint64_t done = 0; done < size; ) {
+        size_t chunk = size - done < VERIFY_BUF ? (size_t)(size - done) : VERIFY_BUF;
+        if (pkg_view_read(v, *buf, chunk, offset + done) != 0) return -1;
+        sha256_update(sha, *buf, chunk);
+        done += chunk;
+    }
+    return 0;
+}
+
+static int hash_region(const struct pkg_view *v, const struct verify_region *r,
+                       uint8_t **buf, uint8_t digest[SHA256_BLOCK_SIZE])
+{
+    SHA256_CTX sha;
+    sha256_init(&sha);
+
+    if (!r->ranges) {
+        if (hash_range(v, r->offset, r->size, buf, &sha) != 0) return -1;
+    } else {
+        for (size_t k = 0; k < r->nranges; k++)
+            if (hash_range(v, r->ranges[k].offset, r->ranges[k].size, buf, &sha) != 0) return -1;
+    }
+
+    sha256_final(&sha, digest);
+    return 0;
+}
+
+static void *verify_worker(void *arg)
+{
+    struct verify_pool *pool = arg;
+    uint8_t *buf = NULL;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (i >= pool->count) break;
+
+        struct verify_region *r = &pool->regions[i];
+        uint8_t digest[SHA256_BLOCK_SIZE];
+        if (hash_region(pool->v, r, &buf, digest) != 0) r->result = -1;
+        else r->result = memcmp(digest, r->expect, sizeof(digest)) ? 1 : 0;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static int region_cmp(const void *a, const void *b)
+{
+    const struct verify_region *x = a, *y = b;
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    return 0;
+}
+
+static int is_zero(const uint8_t *p, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        if (p[i]) return 0;
+    return 1;
+}
+
+/* main_entries1/2: the data of the first 'n' table entries, in table order */
+static int add_main_entries(struct pkg_view *v, struct verify_region *r, const char *what,
+                            uint16_t n, const uint8_t *expect)
+{
+    if (n == 0 || n > v->entry_count || is_zero(expect, SHA256_BLOCK_SIZE)) return -1;
+    if (!(r->ranges = calloc(n, sizeof(*r->ranges)))) return -1;
+
+    for (uint16_t i = 0; i < n; i++) {
+        const struct pkg_entry *e = pkg_view_entry(v, i);
+        if ((uint64_t)e->offset + e->size > v->file_size - v->base) {
+            free(r->ranges);
+            memset(r, 0, sizeof(*r));
+            return -1;
+        }
+        r->ranges[i].offset = v->base + e->offset;
+        r->ranges[i].size   = e->size;
+        r->size += e->size;
+    }
+    snprintf(r->what, sizeof(r->what), "%s", what);
+    r->offset       = r->ranges[0].offset;
+    r->nranges      = n;
+    r->main_entries = 1;
+    memcpy(r->expect, expect, SHA256_BLOCK_SIZE);
+    return 0;
+}
+
+/* ------------------- Check ------------------- */
+int pkg_verify(struct pkg_view *v, int threads, struct pkg_verify_result *res)
+{
+    struct pkg_verify_result local;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+
+    if (!v->table) {
+        write_log(g_log_path, "verify: %s has no loaded package table, not checked", v->path);
+        return 1;
+    }
+
+    uint64_t start = get_time_usec();
+    const struct pkg_entry *digests = pkg_view_find(v, PS4_PKG_ENTRY_TYPE_DIGEST_TABLE);
+    size_t cap = 5 + (digests ? v->entry_count : 0);
+    struct verify_region *regions = calloc(cap, sizeof(*regions));
+    if (!regions) return 1;
+    size_t count = 0;
+
+    /* body: big-endian u64 offset / size at 0x20 / 0x28, relative to the header */
+    uint64_t body_off  = ((uint64_t)pkg_be32(v->hdr.unk_0x20) << 32) | pkg_be32(v->hdr.body_offset);
+    uint64_t body_size = ((uint64_t)pkg_be32(v->hdr.unk_0x28) << 32) | pkg_be32(v->hdr.body_size);
+    if (body_size && !is_zero(v->hdr.body_digest, SHA256_BLOCK_SIZE) &&
+        body_off <= v->file_size - v->base && body_size <= v->file_size - v->base - body_off) {
+        struct verify_region *r = &regions[count++];
+        snprintf(r->what, sizeof(r->what), "body");
+        r->offset  = v->base + body_off;
+        r->size    = body_size;
+        r->is_body = 1;
+        memcpy(r->expect, v->hdr.body_digest, SHA256_BLOCK_SIZE);
+    } else {
+        write_log(g_log_path, "verify: body 0x%llX+0x%llX not checked",
+                  (unsigned long long)body_off, (unsigned long long)body_size);
+    }
+
+    /* PFS image: pfs_image_offset / size, big-endian u64 at 0x410 / 0x418 */
+    struct cnt_pkg_content_header content;
+    uint64_t pfs_off = 0, pfs_size = 0;
+    if (pkg_view_read(v, &content, sizeof(content), v->base + 0x400) == 0) {
+        pfs_off  = ((uint64_t)pkg_be32(content.unk_0x410) << 32) | pkg_be32(content.content_offset);
+        pfs_size = ((uint64_t)pkg_be32(content.unk_0x418) << 32) | pkg_be32(content.content_size);
+    }
+    if (pfs_size && !is_zero(content.content_digest, SHA256_BLOCK_SIZE) &&
+        pfs_off <= v->file_size - v->base && pfs_size <= v->file_size - v->base - pfs_off) {
+        struct verify_region *r = &regions[count++];
+        snprintf(r->what, sizeof(r->what), "PFS image");
+        r->offset = v->base + pfs_off;
+        r->size   = pfs_size;
+        memcpy(r->expect, content.content_digest, SHA256_BLOCK_SIZE);
+    } else {
+        write_log(g_log_path, "verify: PFS image 0x%llX+0x%llX not checked",
+                  (unsigned long long)pfs_off, (unsigned long long)pfs_size);
+    }
+
+    /* main_entries1/2: the first system_entries_num (0x14) and
+       unk2_entries_num (0x16) entries of the table */
+    if (add_main_entries(v, &regions[count], "main entries 1", pkg_be16(v->hdr.system_entries_num),
+                         v->hdr.main_entries1_digest) == 0)
+        count++;
+    if (add_main_entries(v, &regions[count], "main entries 2", pkg_be16(v->hdr.unk2_entries_num),
+                         v->hdr.main_entries2_digest) == 0)
+        count++;
+
+    /* the digest table, then every entry it has a digest for */
+    uint8_t *slots = NULL;
+    if (digests && digests->size && !is_zero(v->hdr.digest_table_digest, SHA256_BLOCK_SIZE)) {
+        struct verify_region *r = &regions[count++];
+        snprintf(r->what, sizeof(r->what), "digest table");
+        r->offset   = v->base + digests->offset;
+        r->size     = digests->size;
+        r->is_table = 1;
+        memcpy(r->expect, v->hdr.digest_table_digest, SHA256_BLOCK_SIZE);
+
+        /* one SHA-256 per table entry, in table order */
+        if (digests->size >= (uint64_t)v->entry_count * SHA256_BLOCK_SIZE &&
+            (slots = malloc((size_t)v->entry_count * SHA256_BLOCK_SIZE)) &&
+            pkg_view_read(v, slots, (size_t)v->entry_count * SHA256_BLOCK_SIZE,
+                          r->offset) != 0) {
+            free(slots);
+            slots = NULL;
+        }
+    }
+
+    for (uint16_t i = 0; slots && i < v->entry_count; i++) {
+        const struct pkg_entry *e = pkg_view_entry(v, i);
+        const uint8_t *slot = slots + (size_t)i * SHA256_BLOCK_SIZE;
+        if (e == digests || !e->size || (e->flags1 & ENTRY_ENCRYPTED) ||
+            is_zero(slot, SHA256_BLOCK_SIZE) ||
+            (uint64_t)e->offset + e->size > v->file_size - v->base)
+            continue;
+
+        struct verify_region *r = &regions[count++];
+        snprintf(r->what, sizeof(r->what), "entry 0x%04X (#%u)", e->type, i);
+        r->offset    = v->base + e->offset;
+        r->size      = e->size;
+        r->per_entry = 1;
+        memcpy(r->expect, slot, SHA256_BLOCK_SIZE);
+    }
+    free(slots);
+
+    if (count == 0) {
+        free(regions);
+        write_log(g_log_path, "verify: nothing to check in %s", v->path);
+        return 1;
+    }
+
+    /* largest first, so one big body does not start last */
+    qsort(regions, count, sizeof(*regions), region_cmp);
+
+    if (threads < 1) threads = 1;
+    if (threads > VERIFY_MAX_THREADS) threads = VERIFY_MAX_THREADS;
+    if ((size_t)threads > count) threads = (int)count;
+
+    struct verify_pool pool = { v, regions, count, 0 };
+    pthread_t tids[VERIFY_MAX_THREADS];
+    int started[VERIFY_MAX_THREADS] = {0};
+    for (int t = 1; t < threads; t++)
+        started[t] = pthread_create(&tids[t], NULL, verify_worker, &pool) == 0;
+    verify_worker(&pool);
+    for (int t = 1; t < threads; t++)
+        if (started[t]) pthread_join(tids[t], NULL);
+
+    /* the slots are only as good as the table: when its own digest does
+       not match, that is the failure and the slots are not compared */
+    int trust_entries = 0, has_table = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!regions[i].is_table) continue;
+        has_table     = 1;
+        trust_entries = regions[i].result == 0;
+    }
+    if (has_table && !trust_entries)
+        write_log(g_log_path, "verify: digest table does not match, per-entry slots ignored");
+
+    /* the main entries lie inside the body: with the body intact, a
+       mismatch means their layout is not the one assumed, not damage */
+    int body_ok = 0;
+    for (size_t i = 0; i < count; i++)
+        if (regions[i].is_body) body_ok = regions[i].result == 0;
+
+    for (size_t i = 0; i < count; i++) {
+        struct verify_region *r = &regions[i];
+        if (r->per_entry && !trust_entries) continue;
+        if (r->main_entries && r->result != 0 && body_ok) {
+            write_log(g_log_path, "verify: %s does not match an intact body, layout not recognised",
+                      r->what);
+            continue;
+        }
+        res->checked++;
+        res->bytes += r->size;
+        if (r->result == 0) continue;
+        res->failed++;
+        write_log(g_log_path, "verify: %s (%llu bytes @ 0x%llX) %s", r->what,
+                  (unsigned long long)r->size, (unsigned long long)r->offset,
+                  r->result < 0 ? "unreadable" : "digest mismatch");
+    }
+    for (size_t i = 0; i < count; i++)
+        free(regions[i].ranges);
+    free(regions);
+
+    res->secs = (get_time_usec() - start) / 1e6;
+    write_log(g_log_path, "verify: %s: %d regions, %d failed, %.1f MB in %.1f ms (%d threads)",
+              v->path, res->checked, res->failed, res->bytes / 1048576.0,
+              res->secs * 1000.0, threads);
+    return res->failed ? -1 : 0;
+}
@@ -0,0 +1,300 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "planner.h"
+#include "pfs.h"
+#include "filter.h"
+#include "utils.h"
+
+#define PLAN_SAMPLE_BYTES  0x800000   /* sequential probe per source: 8 MB */
+#define PLAN_MIN_SAMPLE    0x40000    /* below 256 KB a rate means nothing */
+#define PLAN_SAMPLE_FILES  32         /* open/read/close probes on the mount */
+#define PLAN_SMALL_READ    0x1000
+#define PLAN_INFLATE_MAX   0x2000000  /* largest PFSC file decompressed as a probe */
+#define PLAN_BUF           0x100000
+
+/* ----------------------------------------------------------------- */
+/*  Probes                                                           */
+/* ----------------------------------------------------------------- */
+
+/* Read [off, off + len) of a file node straight from the image */
+static int probe_image(struct pfs_image *img, const struct pfs_tree *tree,
+                       const struct pfs_node *node, uint64_t off, uint64_t len, uint8_t *buf)
+{
+    while (len) {
+        size_t chunk = len < PLAN_BUF ? (size_t)len : PLAN_BUF;
+        if (pfs_node_read(img, tree, node, off, buf, chunk) != 0) return -1;
+        off += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* Same bytes through the mounted filesystem */
+static int probe_sandbox(const char *path, uint64_t off, uint64_t len, uint8_t *buf)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    while (len) {
+        size_t chunk = len < PLAN_BUF ? (size_t)len : PLAN_BUF;
+        if (pread(fd, buf, chunk, (off_t)off) != (ssize_t)chunk) break;
+        off += chunk;
+        len -= chunk;
+    }
+    close(fd);
+    return len == 0 ? 0 : -1;
+}
+
+/* One small-file visit: lookup, open, first page, close */
+static int probe_lookup(const char *path, uint8_t *buf)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    int ret = fstat(fd, &st) == 0 && read(fd, buf, PLAN_SMALL_READ) >= 0 ? 0 : -1;
+    close(fd);
+    return ret;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Estimate both sources and pick one                               */
+/* ----------------------------------------------------------------- */
+static const char *source_name(int source)
+{
+    return source == PLAN_IMAGE ? "image" : "sandbox";
+}
+
+static uint64_t probe_half(const struct pfs_node *node)
+{
+    return node->size / 2 < PLAN_SAMPLE_BYTES ? node->size / 2 : PLAN_SAMPLE_BYTES;
+}
+
+static double probe_rate(uint64_t bytes, uint64_t usecs)
+{
+    return bytes >= PLAN_MIN_SAMPLE ? bytes / ((usecs + 1) / 1e6) : 0;
+}
+
+static int plan_estimate(struct pfs_image *img, const struct pfs_tree *tree,
+                         const uint8_t *select, const char *sandbox_dir,
+                         struct pfs_plan *plan)
+{
+    /* what would be copied: the same files either way. On the image, raw
+       files cost their bytes and compressed ones their decompression */
+    uint64_t raw_bytes = 0, packed_bytes = 0;
+    size_t   big = 0, largest = 0, packed = 0;
+    size_t  *files = malloc(tree->node_count * sizeof(*files));
+    if (!files) return -1;
+
+    for (size_t i = 1; i < tree->node_count; ++i) {
+        const struct pfs_node *node = &tree->nodes[i];
+        if (node->type != PFS_NODE_FILE || (select && select[i] != PFS_SELECT_ALL)) continue;
+        files[plan->files++] = i;
+        plan->bytes += node->size;
+        if (!largest || node->size > tree->nodes[largest].size) largest = i;
+        if (node->compressed) {
+            packed_bytes += node->size;
+            if (node->stored_size <= PLAN_INFLATE_MAX &&
+                (!packed || node->stored_size > tree->nodes[packed].stored_size))
+                packed = i;
+            continue;
+        }
+        raw_bytes += node->size;
+        if (!big || node->size > tree->nodes[big].size) big = i;
+    }
+
+    uint8_t *buf = malloc(PLAN_BUF);
+    if (!buf || plan->files == 0) {
+        free(buf);
+        free(files);
+        return -1;
+    }
+
+    char path[1024];
+    uint64_t image_bytes = 0, image_us = 0, sandbox_bytes = 0, sandbox_us = 0, t0;
+
+    /* sequential rates: the image reads the first half of the largest
+       raw file, the mount the second half of the largest file, so one
+       probe does not warm the cache for the other */
+    const struct pfs_node *node;
+    uint64_t sample;
+    if (big && (sample = probe_half(&tree->nodes[big])) >= PLAN_MIN_SAMPLE) {
+        node = &tree->nodes[big];
+        t0 = get_time_usec();
+        if (probe_image(img, tree, node, 0, sample, buf) == 0) {
+            image_us    = get_time_usec() - t0;
+            image_bytes = sample;
+        }
+    }
+    if ((sample = probe_half(&tree->nodes[largest])) >= PLAN_MIN_SAMPLE) {
+        node = &tree->nodes[largest];
+        snprintf(path, sizeof(path), "%s/%s", sandbox_dir, node->path);
+        t0 = get_time_usec();
+        if (probe_sandbox(path, node->size - sample, sample, buf) == 0) {
+            sandbox_us    = get_time_usec() - t0;
+            sandbox_bytes = sample;
+        }
+    }
+
+    /* no big file for a source: whole small ones instead, alternating so
+       the two never read the same file */
+    int image_todo = image_bytes == 0, sandbox_todo = sandbox_bytes == 0, side = 0;
+    for (size_t k = 0; k < plan->files && (image_todo || sandbox_todo); ++k) {
+        node = &tree->nodes[files[k]];
+        if (node->size == 0) continue;
+        side ^= 1;
+        if (side && image_todo && !node->compressed) {
+            t0 = get_time_usec();
+            if (probe_image(img, tree, node, 0, node->size, buf) == 0) {
+                image_us    += get_time_usec() - t0;
+                image_bytes += node->size;
+            }
+        } else if (sandbox_todo) {
+            snprintf(path, sizeof(path), "%s/%s", sandbox_dir, node->path);
+            t0 = get_time_usec();
+            if (probe_sandbox(path, 0, node->size, buf) == 0) {
+                sandbox_us    += get_time_usec() - t0;
+                sandbox_bytes += node->size;
+            }
+        }
+        image_todo   = image_todo   && image_bytes   < PLAN_SAMPLE_BYTES;
+        sandbox_todo = sandbox_todo && sandbox_bytes < PLAN_SAMPLE_BYTES;
+    }
+    double image_rate   = probe_rate(image_bytes, image_us);
+    double sandbox_rate = probe_rate(sandbox_bytes, sandbox_us);
+
+    /* decompression: the largest PFSC file under the cap, inflated inline */
+    double inflate_rate = 0;
+    int null_fd;
+    if (packed && (null_fd = open("/dev/null", O_WRONLY)) >= 0) {
+        uint64_t written = 0;
+        t0 = get_time_usec();
+        if (pfs_node_inflate(img, tree, &tree->nodes[packed], null_fd, &written) == 0)
+            inflate_rate = written / ((get_time_usec() - t0 + 1) / 1e6);
+        close(null_fd);
+    }
+
+    /* per-file cost on both sides, files spread over the whole tree */
+    size_t step = plan->files > PLAN_SAMPLE_FILES ? plan->files / PLAN_SAMPLE_FILES : 1;
+    int image_probed = 0, sandbox_probed = 0;
+    uint64_t image_files_us = 0;
+    t0 = get_time_usec();
+    for (size_t k = 0; k < plan->files && sandbox_probed < PLAN_SAMPLE_FILES; k += step) {
+        if (files[k] == big || files[k] == largest) continue;
+        snprintf(path, sizeof(path), "%s/%s", sandbox_dir, tree->nodes[files[k]].path);
+        if (probe_lookup(path, buf) == 0) sandbox_probed++;
+    }
+    double per_file = sandbox_probed ? (get_time_usec() - t0) / 1e6 / sandbox_probed : 0;
+    for (size_t k = 0; k < plan->files && image_probed < PLAN_SAMPLE_FILES; k += step) {
+        node = &tree->nodes[files[k]];
+        if (files[k] == big || files[k] == largest || node->compressed) continue;
+        uint64_t len = node->size < PLAN_SMALL_READ ? node->size : PLAN_SMALL_READ;
+        t0 = get_time_usec();
+        if (probe_image(img, tree, node, 0, len, buf) == 0) {
+            image_files_us += get_time_usec() - t0;
+            image_probed++;
+        }
+    }
+    double image_per_file = image_probed ? image_files_us / 1e6 / image_probed : 0;
+
+    free(buf);
+    free(files);
+
+    /* a byte class too small to sample costs ~nothing; any other class
+       without a rate leaves its source unmeasured */
+    int image_known   = (image_rate || raw_bytes < PLAN_MIN_SAMPLE) &&
+                        (inflate_rate || packed_bytes < PLAN_MIN_SAMPLE);
+    int sandbox_known = sandbox_rate || plan->bytes < PLAN_MIN_SAMPLE;
+
+    plan->image_secs = !image_known ? 0 :
+                       (image_rate   ? raw_bytes / image_rate     : 0) +
+                       (inflate_rate ? packed_bytes / inflate_rate : 0) +
+                       image_per_file * (double)plan->files;
+    plan->sandbox_secs = !sandbox_known ? 0 :
+                         (sandbox_rate ? plan->bytes / sandbox_rate : 0) +
+                         per_file * (double)plan->files;
+    if (image_known && sandbox_known)
+        plan->source = plan->image_secs <= plan->sandbox_secs ? PLAN_IMAGE : PLAN_SANDBOX;
+    else
+        plan->source = image_known ? PLAN_IMAGE : PLAN_SANDBOX;
+
+    write_log(g_log_path, "planner: %llu files, %.1f MB (avg %.1f KB, %zu compressed)",
+              (unsigned long long)plan->files, plan->bytes / 1048576.0,
+              plan->bytes / 1024.0 / plan->files, tree->compressed_count);
+    write_log(g_log_path, "planner: image %.1f MB/s + %.1f MB/s inflated + %.3f ms/file -> %.2f s%s"
+              " | sandbox %.1f MB/s + %.3f ms/file -> %.2f s%s",
+              image_rate / 1048576.0, inflate_rate / 1048576.0, image_per_file * 1000.0,
+              plan->image_secs, image_known ? "" : " (not measured)",
+              sandbox_rate / 1048576.0, per_file * 1000.0,
+              plan->sandbox_secs, sandbox_known ? "" : " (not measured)");
+    return 0;
+}
+
+int plan_pfs_source(const char *image_path, const char *sandbox_dir, struct pfs_plan *plan)
+{
+    struct pfs_plan local;
+    if (!plan) plan = &local;
+    memset(plan, 0, sizeof(*plan));
+
+    int have_image   = image_path && file_exists(image_path);
+    int have_sandbox = sandbox_dir && dir_exists(sandbox_dir);
+    if (!have_image && !have_sandbox) return -1;
+
+    /* forced by config.ini, or only one candidate */
+    int forced = g_pfs_source == PLAN_IMAGE && have_image ? PLAN_IMAGE :
+                 g_pfs_source == PLAN_SANDBOX && have_sandbox ? PLAN_SANDBOX : PLAN_AUTO;
+    if (forced == PLAN_AUTO && !(have_image && have_sandbox))
+        forced = have_image ? PLAN_IMAGE : PLAN_SANDBOX;
+    if (forced != PLAN_AUTO) {
+        plan->source = forced;
+        write_log(g_log_path, "planner: using %s (%s)", source_name(forced),
+                  g_pfs_source == forced ? "pfs_source" : "only source");
+        return forced;
+    }
+
+    uint64_t start = get_time_usec();
+    struct pfs_image img;
+    struct pfs_tree tree;
+    int filtered;
+    if (pfs_open_tree(image_path, 0, 0, &img, &tree, &filtered) != 0) {
+        /* encrypted or damaged image: the mount is all we have */
+        plan->source = PLAN_SANDBOX;
+        write_log(g_log_path, "planner: %s unreadable, using sandbox", image_path);
+        return PLAN_SANDBOX;
+    }
+
+    uint8_t *select = NULL;
+    if ((filter_active() || g_route_self) && (select = malloc(tree.node_count)))
+        pfs_tree_filter(&img, &tree, select, NULL);
+
+    int ret = plan_estimate(&img, &tree, select, sandbox_dir, plan);
+    if (ret != 0) plan->source = PLAN_SANDBOX;
+
+    free(select);
+    pfs_tree_free(&tree);
+    pfs_close(&img);
+
+    write_log(g_log_path, "planner: using %s for %s (planned in %.1f ms)",
+              source_name(plan->source), sandbox_dir,
+              (get_time_usec() - start) / 1000.0);
+    return plan->source;
+}
@@ -177,7 +177,9 @@ static int patch_elf(const char* path)
     struct stat st;
     if (fstat(fd, &st) < 0 || st.st_size < 0x40) { close(fd); return -1; }
 
+    selfpager_lock();
     uint8_t *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    selfpager_unlock();
     if (map == MAP_FAILED) { close(fd); return -1; }
 
     int patched = 0;
@@ -310,7 +312,9 @@ int ps4_backport_param_sfo(const char* sfo_path)
     struct stat st;
     if (fstat(fd, &st) < 0 || st.st_size < 0x20) { close(fd); return -1; }
 
+    selfpager_lock();
     uint8_t *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    selfpager_unlock();
     if (map == MAP_FAILED) { close(fd); return -1; }
 
     int patched = 0;
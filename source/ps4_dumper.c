@@ -24,6 +24,8 @@ along with this program; see the file COPYING. If not, see
 
 #include "ps4_dumper.h"
 #include "ps4_pkg.h"
+#include "pkg_verify.h"
+#include "planner.h"
 #include "utils.h"
 
 extern int decrypt_all(const char *src_game, const char *dst_game,
@@ -34,7 +36,9 @@ extern int decrypt_all(const char *src_game, const char *dst_game,
 /* ----------------------------------------------------------------- */
 static void pfs_progress(uint64_t copied, uint64_t total, const char *current_file)
 {
-    total_bytes_copied = copied;
+    /* unpfs workers already add to total_bytes_copied atomically; storing
+       a snapshot here would drop bytes another worker just added */
+    (void)copied;
     folder_size_current = total;
     if (current_file) {
         strncpy(current_copied, current_file, sizeof(current_copied) - 1);
@@ -86,8 +90,8 @@ static void copy_meta_file(const char *tmpl, const char *title_id,
 /* ----------------------------------------------------------------- */
 /*  Extract PFS image with progress                                  */
 /* ----------------------------------------------------------------- */
-static int extract_pfs_image(const char *pfs_path, const char *dst_dir,
-                             const char *type, const char *logpath)
+static int extract_pfs_image(const char *pfs_path, uint64_t base, uint64_t size,
+                             const char *dst_dir, const char *type, const char *logpath)
 {
     if (!file_exists(pfs_path)) {
         write_log(logpath, "Info: No %s pfs_image.dat found: %s", type, pfs_path);
@@ -113,10 +117,13 @@ static int extract_pfs_image(const char *pfs_path, const char *dst_dir,
         progress_thread = 0;
     }
 
-    if (unpfs(pfs_path, dst_dir, pfs_progress) != 0) {
+    if (unpfs_range(pfs_path, base, size, dst_dir, pfs_progress) != 0) {
         write_log(logpath, "ERROR: unpfs failed for %s: %s", type, pfs_path);
         progress_thread_run = 0;
-        if (progress_thread) pthread_join(progress_thread, NULL);
+        if (progress_thread) {
+            pthread_join(progress_thread, NULL);
+            progress_thread = 0;
+        }
         return -1;
     }
 
@@ -131,6 +138,98 @@ static int extract_pfs_image(const char *pfs_path, const char *dst_dir,
     return 0;
 }
 
+/* ----------------------------------------------------------------- */
+/*  Copy the mounted sandbox with progress (planner chose the mount) */
+/* ----------------------------------------------------------------- */
+static int copy_sandbox_dir(const char *src_dir, const char *dst_dir,
+                            const char *type, const char *logpath)
+{
+    printf_notification("Copying %s files...", type);
+
+    // Reset progress state
+    folder_size_current = 0;
+    total_bytes_copied = 0;
+    current_copied[0] = '\0';
+    size_walker_filtered(src_dir, &folder_size_current);
+    copy_start_time = time(NULL);
+
+    // Restart progress thread
+    if (progress_thread) {
+        progress_thread_run = 0;
+        pthread_join(progress_thread, NULL);
+        progress_thread = 0;
+    }
+    progress_thread_run = 1;
+    if (pthread_create(&progress_thread, NULL, progress_status_func, NULL) != 0) {
+        progress_thread = 0;
+    }
+
+    copy_dir_filtered(src_dir, dst_dir);
+
+    // Stop progress thread
+    progress_thread_run = 0;
+    if (progress_thread) {
+        pthread_join(progress_thread, NULL);
+        progress_thread = 0;
+    }
+
+    write_log(logpath, "Copied %s sandbox: %s -> %s", type, src_dir, dst_dir);
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Raw image or mounted sandbox, whichever the planner expects to   */
+/*  finish first                                                     */
+/* ----------------------------------------------------------------- */
+static int dump_pfs_source(const char *pfs_path, const char *sandbox_dir,
+                           const char *dst_dir, const char *type, const char *logpath)
+{
+    if (plan_pfs_source(pfs_path, sandbox_dir, NULL) == PLAN_SANDBOX)
+        return copy_sandbox_dir(sandbox_dir, dst_dir, type, logpath);
+    if (extract_pfs_image(pfs_path, 0, 0, dst_dir, type, logpath) == 0)
+        return 0;
+
+    /* some files failed to extract: the mount still has all of them */
+    if (!dir_exists(sandbox_dir)) return -1;
+    write_log(logpath, "unpfs failed, copying the %s sandbox instead", type);
+    return copy_sandbox_dir(sandbox_dir, dst_dir, type, logpath);
+}
+
+/* ----------------------------------------------------------------- */
+/*  No nest mount: read the inner PFS straight out of the fake PKG   */
+/* ----------------------------------------------------------------- */
+static int extract_pkg_pfs_image(const struct pkg_view *pkg, const char *dst_dir,
+                                 const char *type, const char *logpath)
+{
+    const char *pkg_path = pkg->path;
+    uint64_t outer_off, outer_size, inner_off, inner_size;
+    if (pkg_ps4_pfs_range(pkg, &outer_off, &outer_size) != 0 ||
+        pfs_locate_file(pkg_path, outer_off, outer_size, "pfs_image.dat",
+                        &inner_off, &inner_size) != 0) {
+        write_log(logpath, "Info: No readable %s PFS inside %s", type, pkg_path);
+        return -1;
+    }
+
+    write_log(logpath, "Found %s PFS inside %s at 0x%llx (%llu bytes)", type, pkg_path,
+              (unsigned long long)inner_off, (unsigned long long)inner_size);
+    return extract_pfs_image(pkg_path, inner_off, inner_size, dst_dir, type, logpath);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Package digest check (verify_pkg = 1), before any PFS is copied  */
+/* ----------------------------------------------------------------- */
+static int check_pkg(struct pkg_view *pkg, const char *type, const char *logpath)
+{
+    if (!g_verify_pkg) return 0;
+
+    printf_notification("Verifying %s package...", type);
+    if (pkg_verify(pkg, PKG_VERIFY_THREADS, NULL) >= 0) return 0;
+
+    write_log(logpath, "ERROR: %s package %s failed the digest check, dump stopped", type, pkg->path);
+    printf_notification("ERROR: %s package is corrupt, dump stopped", type);
+    return -1;
+}
+
 /* ----------------------------------------------------------------- */
 /*  Decrypt SELFs if requested                                       */
 /* ----------------------------------------------------------------- */
@@ -159,6 +258,56 @@ static int decrypt_if_needed(const char *sandbox_root, const char *title_id,
     return 0;
 }
 
+/* ----------------------------------------------------------------- */
+/*  Title ID and sandbox root from the caller's arguments            */
+/* ----------------------------------------------------------------- */
+static int resolve_title(const char *title_id_param, const char *app_folder,
+                         char *title_id, size_t title_size,
+                         char *sandbox_root, size_t root_size)
+{
+    const char *default_sandbox_root = "/mnt/sandbox/pfsmnt";
+
+    if (is_path_like(title_id_param)) {
+        strncpy(sandbox_root, title_id_param, root_size-1);
+        if (app_folder && app_folder[0]) {
+            extract_title_from_folder(app_folder, title_id, title_size);
+        } else {
+            write_log(g_log_path, "ERROR: app_folder required when passing sandbox path");
+            printf_notification("ERROR: app_folder required");
+            return -1;
+        }
+    } else {
+        strncpy(title_id, title_id_param ? title_id_param : "", title_size-1);
+        strncpy(sandbox_root, default_sandbox_root, root_size-1);
+    }
+    return 0;
+}
+
+/* ----------------------------------------------------------------- */
+/*  Destination folders for a split mode                             */
+/* ----------------------------------------------------------------- */
+static void dump_dirs(const char *usb_base, const char *title_id, int split,
+                      char *dst_app, char *dst_pat, size_t size, int create)
+{
+    char base_path[1024];
+    snprintf(base_path, sizeof(base_path), "%s/%s", usb_base, title_id);
+
+    if (split == 0) {
+        snprintf(dst_app, size, "%s", base_path);
+        snprintf(dst_pat, size, "%s", base_path);
+        if (create) mkdirs(dst_app);
+    } else {
+        if (split & 1) {
+            snprintf(dst_app, size, "%s-app0", base_path);
+            if (create) mkdirs(dst_app);
+        }
+        if (split & 2) {
+            snprintf(dst_pat, size, "%s-patch0", base_path);
+            if (create) mkdirs(dst_pat);
+        }
+    }
+}
+
 /* ----------------------------------------------------------------- */
 /*  Main dump function                                               */
 /* ----------------------------------------------------------------- */
@@ -174,21 +323,9 @@ int dump_ps4_cusa_app_real(
 {
     char title_id[128] = {0};
     char sandbox_root[1024] = {0};
-    const char *default_sandbox_root = "/mnt/sandbox/pfsmnt";
-
-    if (is_path_like(title_id_param)) {
-        strncpy(sandbox_root, title_id_param, sizeof(sandbox_root)-1);
-        if (app_folder && app_folder[0]) {
-            extract_title_from_folder(app_folder, title_id, sizeof(title_id));
-        } else {
-            write_log(g_log_path, "ERROR: app_folder required when passing sandbox path");
-            printf_notification("ERROR: app_folder required");
-            return -1;
-        }
-    } else {
-        strncpy(title_id, title_id_param ? title_id_param : "", sizeof(title_id)-1);
-        strncpy(sandbox_root, default_sandbox_root, sizeof(sandbox_root)-1);
-    }
+    if (resolve_title(title_id_param, app_folder, title_id, sizeof(title_id),
+                      sandbox_root, sizeof(sandbox_root)) != 0)
+        return -1;
 
     const char *usb_base = usb_path ? usb_path : "/mnt/usb0";
 
@@ -196,30 +333,14 @@ int dump_ps4_cusa_app_real(
     snprintf(logpath, sizeof(logpath), "%s/log.txt", usb_base);
     write_log(logpath, "Starting dump for %s (split=%d) [sandbox=%s]", title_id, g_split_mode, sandbox_root);
 
-    char base_path[1024] = {0};
     char dst_app[1024]   = {0};
     char dst_pat[1024]   = {0};
-
-    snprintf(base_path, sizeof(base_path), "%s/%s", usb_base, title_id);
-
-    if (g_split_mode == 0) {
-        snprintf(dst_app, sizeof(dst_app), "%s", base_path);
-        snprintf(dst_pat, sizeof(dst_pat), "%s", base_path);
-        mkdirs(dst_app);
-    } else {
-        if (g_split_mode & 1) {
-            snprintf(dst_app, sizeof(dst_app), "%s-app0", base_path);
-            mkdirs(dst_app);
-        }
-        if (g_split_mode & 2) {
-            snprintf(dst_pat, sizeof(dst_pat), "%s-patch0", base_path);
-            mkdirs(dst_pat);
-        }
-    }
+    dump_dirs(usb_base, title_id, g_split_mode, dst_app, dst_pat, sizeof(dst_app), 1);
 
     /* === APP BLOCK === */
     if ((!g_split_mode) || (g_split_mode & 1)) {
         char src_pkg[1024] = {0};
+        struct pkg_view pkg;
         int pkg_existed = 0;
 
         const char *pkg_paths[] = {
@@ -231,12 +352,19 @@ int dump_ps4_cusa_app_real(
 
         for (int i = 0; pkg_paths[i]; ++i) {
             snprintf(src_pkg, sizeof(src_pkg), pkg_paths[i], title_id);
-            if (file_exists(src_pkg) && isfpkg_ps4(src_pkg) == 0) {
+            /* one open + map per package: validation, sce_sys and the PFS */
+            if (!file_exists(src_pkg) || pkg_view_open(&pkg, src_pkg) != 0) continue;
+            if (isfpkg_ps4(&pkg) == 0) {
                 printf_notification("Extracting app package...");
-                unpkg_ps4(src_pkg, dst_app);
+                unpkg_ps4(&pkg, dst_app);
                 pkg_existed = 1;
                 break;
             }
+            pkg_view_close(&pkg);
+        }
+        if (pkg_existed && check_pkg(&pkg, "app", logpath) != 0) {
+            pkg_view_close(&pkg);
+            return -1;
         }
 
         char sce_sys[1024];
@@ -246,14 +374,16 @@ int dump_ps4_cusa_app_real(
         copy_meta_file("/system_data/priv/appmeta/%s/nptitle.dat", title_id, dst_app, logpath);
         copy_meta_file("/system_data/priv/appmeta/%s/npbind.dat",  title_id, dst_app, logpath);
 
-        char pfs_path[1024];
+        char pfs_path[1024], sandbox_dir[1024];
         snprintf(pfs_path, sizeof(pfs_path), "%s/%s-app0-nest/pfs_image.dat", sandbox_root, title_id);
+        snprintf(sandbox_dir, sizeof(sandbox_dir), "%s/%s-app0", sandbox_root, title_id);
         if (file_exists(pfs_path)) {
             write_log(logpath, "Found app PFS (PKG: %s): %s", pkg_existed ? "YES" : "NO", pfs_path);
-            extract_pfs_image(pfs_path, dst_app, "app", logpath);
-        } else {
+            dump_pfs_source(pfs_path, sandbox_dir, dst_app, "app", logpath);
+        } else if (!pkg_existed || extract_pkg_pfs_image(&pkg, dst_app, "app", logpath) != 0) {
             write_log(logpath, "No app PFS found: %s", pfs_path);
         }
+        if (pkg_existed) pkg_view_close(&pkg);
 
         decrypt_if_needed(sandbox_root, title_id, "app0", dst_app,
                           do_decrypt, do_elf2fself, do_backport, logpath);
@@ -262,6 +392,7 @@ int dump_ps4_cusa_app_real(
     /* === PATCH BLOCK === */
     if ((!g_split_mode) || (g_split_mode & 2)) {
         char src_pkg[1024] = {0};
+        struct pkg_view pkg;
         int pkg_existed = 0;
 
         const char *pkg_paths[] = {
@@ -273,12 +404,19 @@ int dump_ps4_cusa_app_real(
 
         for (int i = 0; pkg_paths[i]; ++i) {
             snprintf(src_pkg, sizeof(src_pkg), pkg_paths[i], title_id);
-            if (file_exists(src_pkg) && isfpkg_ps4(src_pkg) == 0) {
+            /* one open + map per package: validation, sce_sys and the PFS */
+            if (!file_exists(src_pkg) || pkg_view_open(&pkg, src_pkg) != 0) continue;
+            if (isfpkg_ps4(&pkg) == 0) {
                 printf_notification("Extracting patch package...");
-                unpkg_ps4(src_pkg, dst_pat);
+                unpkg_ps4(&pkg, dst_pat);
                 pkg_existed = 1;
                 break;
             }
+            pkg_view_close(&pkg);
+        }
+        if (pkg_existed && check_pkg(&pkg, "patch", logpath) != 0) {
+            pkg_view_close(&pkg);
+            return -1;
         }
 
         char sce_sys[1024];
@@ -288,14 +426,16 @@ int dump_ps4_cusa_app_real(
         copy_meta_file("/system_data/priv/appmeta/%s/nptitle.dat", title_id, dst_pat, logpath);
         copy_meta_file("/system_data/priv/appmeta/%s/npbind.dat",  title_id, dst_pat, logpath);
 
-        char pfs_path[1024];
+        char pfs_path[1024], sandbox_dir[1024];
         snprintf(pfs_path, sizeof(pfs_path), "%s/%s-patch0-nest/pfs_image.dat", sandbox_root, title_id);
+        snprintf(sandbox_dir, sizeof(sandbox_dir), "%s/%s-patch0", sandbox_root, title_id);
         if (file_exists(pfs_path)) {
             write_log(logpath, "Found patch PFS (PKG: %s): %s", pkg_existed ? "YES" : "NO", pfs_path);
-            extract_pfs_image(pfs_path, dst_pat, "patch", logpath);
-        } else {
+            dump_pfs_source(pfs_path, sandbox_dir, dst_pat, "patch", logpath);
+        } else if (!pkg_existed || extract_pkg_pfs_image(&pkg, dst_pat, "patch", logpath) != 0) {
             write_log(logpath, "No patch PFS found: %s", pfs_path);
         }
+        if (pkg_existed) pkg_view_close(&pkg);
 
         decrypt_if_needed(sandbox_root, title_id, "patch0", dst_pat,
                           do_decrypt, do_elf2fself, do_backport, logpath);
@@ -386,4 +526,45 @@ int dump_ps4_cusa_app(
 
     g_split_mode = old_split;
     return ret;
-}
\ No newline at end of file
+}
+
+/* ----------------------------------------------------------------- */
+/*  Decrypt an already copied dump (the batch queue defers this)     */
+/*  Same arguments and destination folders as dump_ps4_cusa_app().   */
+/* ----------------------------------------------------------------- */
+int decrypt_ps4_cusa_app(
+    const char *title_id_param,
+    const char *app_folder,
+    const char *patch_folder,
+    const char *usb_path,
+    int do_elf2fself,
+    int do_backport
+)
+{
+    char title_id[128] = {0};
+    char sandbox_root[1024] = {0};
+    if (resolve_title(title_id_param, app_folder, title_id, sizeof(title_id),
+                      sandbox_root, sizeof(sandbox_root)) != 0)
+        return -1;
+
+    int split = 0;
+    if (app_folder && app_folder[0])   split |= 1;
+    if (patch_folder && patch_folder[0]) split |= 2;
+
+    const char *usb_base = usb_path ? usb_path : "/mnt/usb0";
+    char logpath[512];
+    snprintf(logpath, sizeof(logpath), "%s/log.txt", usb_base);
+
+    char dst_app[1024] = {0};
+    char dst_pat[1024] = {0};
+    dump_dirs(usb_base, title_id, split, dst_app, dst_pat, sizeof(dst_app), 0);
+
+    int ret = 0;
+    if (dst_app[0] && decrypt_if_needed(sandbox_root, title_id, "app0", dst_app,
+                                        1, do_elf2fself, do_backport, logpath) != 0)
+        ret = -1;
+    if (dst_pat[0] && decrypt_if_needed(sandbox_root, title_id, "patch0", dst_pat,
+                                        1, do_elf2fself, do_backport, logpath) != 0)
+        ret = -1;
+    return ret;
+}
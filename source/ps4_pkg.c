@@ -18,36 +18,10 @@ along with this program; see the file COPYING. If not, see
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <errno.h>
 
 #include "ps4_pkg.h"
 #include "utils.h"
 
-/* ------------------- Endian Swap ------------------- */
-static inline uint16_t bswap_16(uint16_t v) {
-    return ((v & 0x00FFU) << 8) | ((v & 0xFF00U) >> 8);
-}
-
-static inline uint32_t bswap_32(uint32_t v) {
-    return ((v & 0x000000FFUL) << 24) |
-           ((v & 0x0000FF00UL) <<  8) |
-           ((v & 0x00FF0000UL) >>  8) |
-           ((v & 0xFF000000UL) >> 24);
-}
-
-/* ------------------- Read Null-Terminated String ------------------- */
-static char* read_string(int fd) {
-    char buf[256];
-    int i = 0;
-    char c;
-    while (read(fd, &c, 1) == 1 && c != '\0' && i < 255)
-        buf[i++] = c;
-    buf[i] = '\0';
-    return strdup(buf);
-}
-
 /* ------------------- Fallback Name Mapping ------------------- */
 static char *get_entry_name_by_type(uint32_t type) {
     switch (type) {
@@ -80,29 +54,23 @@ static char *get_entry_name_by_type(uint32_t type) {
 }
 
 /* ------------------- PKG Validation ------------------- */
-int isfpkg_ps4(const char *pkgfn) {
-    write_log(g_log_path, "isfpkg: Checking %s", pkgfn);
-
-    int fd = open(pkgfn, O_RDONLY);
-    if (fd == -1) {
-        write_log(g_log_path, "isfpkg: open failed (errno: %d)", errno);
-        return 1;
-    }
+int isfpkg_ps4(const struct pkg_view *v) {
+    write_log(g_log_path, "isfpkg: Checking %s", v->path);
 
     uint8_t header[4];
-    if (read(fd, header, 4) != 4) {
-        write_log(g_log_path, "isfpkg: read failed (errno: %d)", errno);
-        close(fd);
+    if (pkg_view_read(v, header, 4, 0) != 0) {
+        write_log(g_log_path, "isfpkg: read failed");
         return 2;
     }
-    close(fd);
 
     uint32_t magic = header[0] | (header[1] << 8) | (header[2] << 16) | (header[3] << 24);
     write_log(g_log_path, "isfpkg: Raw bytes: %02X %02X %02X %02X → magic: 0x%08X",
               header[0], header[1], header[2], header[3], magic);
 
-    if (magic != PS4_PKG_MAGIC) {
-        write_log(g_log_path, "isfpkg: Invalid magic 0x%08X (expected 0x544E437F)", magic);
+    /* "\x7fCNT" on disk: big-endian, so compare both byte orders */
+    if (magic != PS4_PKG_MAGIC && pkg_be32(magic) != PS4_PKG_MAGIC) {
+        write_log(g_log_path, "isfpkg: Invalid magic 0x%08X (expected 0x%08X in either byte order)",
+                  magic, PS4_PKG_MAGIC);
         return 2;
     }
 
@@ -110,58 +78,57 @@ int isfpkg_ps4(const char *pkgfn) {
     return 0;
 }
 
-/* ------------------- Main Extractor ------------------- */
-int unpkg_ps4(const char *pkgfn, const char *tidpath) {
-    write_log(g_log_path, "unpkg: Opening %s", pkgfn);
-    int fdin = open(pkgfn, O_RDONLY);
-    if (fdin == -1) { write_log(g_log_path, "unpkg: open failed (errno: %d)", errno); return 1; }
-
+/* ------------------- PFS Image Location ------------------- */
+/* pfs_image_offset / pfs_image_size: big-endian u64 at 0x410 / 0x418 */
+int pkg_ps4_pfs_range(const struct pkg_view *v, uint64_t *offset, uint64_t *size) {
     struct cnt_pkg_main_header hdr;
-    if (read(fdin, &hdr, sizeof(hdr)) != sizeof(hdr)) { close(fdin); return 2; }
-
-    if (hdr.magic != PS4_PKG_MAGIC) { close(fdin); return 3; }
-    write_log(g_log_path, "unpkg: Valid PS4 PKG");
+    struct cnt_pkg_content_header content;
+    if (pkg_view_read(v, &hdr, sizeof(hdr), 0) != 0 ||
+        pkg_view_read(v, &content, sizeof(content), 0x400) != 0)
+        return 2;
 
-    uint32_t table_offset = bswap_32(hdr.file_table_offset);
-    uint16_t n_entries = bswap_16(hdr.table_entries_num);
-    write_log(g_log_path, "unpkg: Table: %d entries @ 0x%X", n_entries, table_offset);
+    if (hdr.magic != PS4_PKG_MAGIC && pkg_be32(hdr.magic) != PS4_PKG_MAGIC) return 3;
 
-    lseek(fdin, table_offset, SEEK_SET);
-    struct cnt_pkg_table_entry *entries = calloc(n_entries, sizeof(*entries));
-    if (!entries) { close(fdin); return 6; }
-    if (read(fdin, entries, sizeof(*entries) * n_entries) != sizeof(*entries) * n_entries) {
-        free(entries); close(fdin); return 7;
+    uint64_t off = ((uint64_t)pkg_be32(content.unk_0x410) << 32) | pkg_be32(content.content_offset);
+    uint64_t len = ((uint64_t)pkg_be32(content.unk_0x418) << 32) | pkg_be32(content.content_size);
+    if (off == 0 || len == 0 || off > v->file_size || len > v->file_size - off) {
+        write_log(g_log_path, "unpkg: bad PFS image range 0x%llX+0x%llX in %s",
+                  (unsigned long long)off, (unsigned long long)len, v->path);
+        return 4;
     }
 
-    for (int i = 0; i < n_entries; i++) {
-        entries[i].type   = bswap_32(entries[i].type);
-        entries[i].offset = bswap_32(entries[i].offset);
-        entries[i].size   = bswap_32(entries[i].size);
-    }
+    write_log(g_log_path, "unpkg: PFS image at 0x%llX (%llu bytes)",
+              (unsigned long long)off, (unsigned long long)len);
+    *offset = off;
+    *size   = len;
+    return 0;
+}
+
+/* ------------------- Main Extractor ------------------- */
+int unpkg_ps4(struct pkg_view *v, const char *tidpath) {
+    write_log(g_log_path, "unpkg: Opening %s", v->path);
+
+    int err = pkg_view_load(v, 0);
+    if (err == -1) return 2;
+    if (err == -2) return 3;
+    if (err != 0) return 7;
+    write_log(g_log_path, "unpkg: Valid PS4 PKG");
+
+    uint16_t n_entries = v->entry_count;
+    write_log(g_log_path, "unpkg: Table: %d entries @ 0x%X", n_entries, v->table_offset);
 
     char out_dir[512];
     snprintf(out_dir, sizeof(out_dir), "%s/sce_sys", tidpath);
     mkdirs(out_dir);
 
     // === COLLECT NAME TABLE ===
-    char *name_table[256] = {0};
-    int name_idx = 0;
-    for (int i = 0; i < n_entries; i++) {
-        if (entries[i].type == PS4_PKG_ENTRY_TYPE_NAME_TABLE) {
-            off_t pos = entries[i].offset + 1;
-            lseek(fdin, pos, SEEK_SET);
-            while (name_idx < 256) {
-                name_table[name_idx] = read_string(fdin);
-                if (!name_table[name_idx][0]) { free(name_table[name_idx]); break; }
-                name_idx++;
-            }
-            break;
-        }
-    }
+    struct pkg_names names;
+    if (pkg_names_load(v, &names) != 0)
+        write_log(g_log_path, "unpkg: no usable name table, using type names only");
 
     // === CLEAN NAME TABLE PATHS ===
-    for (int i = 0; i < name_idx; i++) {
-        char *name = name_table[i];
+    for (size_t i = 0; i < names.count; i++) {
+        char *name = pkg_name(&names, i);
 
         if (strncmp(name, "/sce_sys/", 9) == 0) memmove(name, name + 9, strlen(name + 9) + 1);
         else if (strncmp(name, "sce_sys/", 8) == 0) memmove(name, name + 8, strlen(name + 8) + 1);
@@ -170,52 +137,34 @@ int unpkg_ps4(const char *pkgfn, const char *tidpath) {
         else if (strncmp(name, "mnt/usb0/", 9) == 0) memmove(name, name + 9, strlen(name + 9) + 1);
 
         if (name[0] == '/') memmove(name, name + 1, strlen(name));
-        write_log(g_log_path, "unpkg: cleaned name[%d] = %s", i, name);
+        write_log(g_log_path, "unpkg: cleaned name[%zu] = %s", i, name);
     }
 
     // === EXTRACT FILES ===
-    int extracted = 0;
-    int name_count = 0;
-
-    for (int i = 0; i < n_entries; i++) {
-        uint32_t type = entries[i].type;
-        uint32_t off  = entries[i].offset;
-        uint32_t sz   = entries[i].size;
+    // names follow table order; the copies then run in offset order
+    struct pkg_job *jobs = calloc(n_entries ? n_entries : 1, sizeof(*jobs));
+    size_t njobs = 0;
+    size_t name_count = 0;
 
-        if (sz == 0 || sz > 100*1024*1024) continue;
+    for (uint16_t i = 0; jobs && i < n_entries; i++) {
+        const struct pkg_entry *entry = pkg_view_entry(v, i);
+        if (entry->size == 0) continue;
 
-        char *name = get_entry_name_by_type(type);
-        if (!name && name_count < name_idx) name = name_table[name_count++];
+        char *name = get_entry_name_by_type(entry->type);
+        if (!name && name_count < names.count) name = pkg_name(&names, name_count++);
 
         if (!name || !name[0]) continue;
 
-        char full[512];
-        snprintf(full, sizeof(full), "%s/%s", out_dir, name);
-
-        char *dir = strdup(full);
-        char *p = strrchr(dir, '/');
-        if (p) { *p = 0; mkdirs(dir); }
-        free(dir);
-
-        uint8_t *buf = malloc(sz);
-        if (!buf) continue;
-
-        lseek(fdin, off, SEEK_SET);
-        if (read(fdin, buf, sz) != sz) { free(buf); continue; }
-
-        int out = open(full, O_WRONLY | O_CREAT | O_TRUNC, 0777);
-        if (out != -1) {
-            write(out, buf, sz);
-            close(out);
-            extracted++;
-            write_log(g_log_path, "unpkg: Extracted %s (%u bytes)", name, sz);
-        }
-        free(buf);
+        jobs[njobs].offset = entry->offset;
+        jobs[njobs].size   = entry->size;
+        jobs[njobs].name   = name;
+        njobs++;
     }
 
-    for (int i = 0; i < name_idx; i++) free(name_table[i]);
-    free(entries);
-    close(fdin);
+    int extracted = jobs ? pkg_extract_jobs(v, jobs, njobs, out_dir) : 0;
+    free(jobs);
+
+    pkg_names_free(&names);
 
     write_log(g_log_path, "unpkg: SUCCESS - %d files extracted", extracted);
     return 0;
@@ -243,7 +243,9 @@ static int patch_elf(const char *path)
     if (fstat(fd, &st) < 0) goto cleanup;
     if (st.st_size < 0x40) goto cleanup;
 
+    selfpager_lock();
     map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    selfpager_unlock();
     if (map == MAP_FAILED) goto cleanup;
 
     /* Skip signed SELF */
@@ -436,7 +438,9 @@ int ps5_backport_param_json(const char *json_path)
     struct stat st;
     if (fstat(fd, &st) < 0 || st.st_size < 100) { close(fd); return -1; }
 
+    selfpager_lock();
     char *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    selfpager_unlock();
     if (map == MAP_FAILED) { close(fd); return -1; }
 
     int patched = 0;
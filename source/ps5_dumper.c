@@ -24,12 +24,46 @@ along with this program; see the file COPYING. If not, see
 
 #include "ps5_dumper.h"
 #include "ps5_pkg.h"
+#include "pkg_verify.h"
+#include "pfs.h"
+#include "planner.h"
 #include "utils.h"
 
 extern int decrypt_all(const char *src_game, const char *dst_game,
                        int do_elf2fself, int do_backport, int is_ps4);
 
 
+/* --------------------------------------------------------------------- */
+/*  decrypt_ps5_ppsa_app() – SELF decryption of a copied dump            */
+/*  Step 10 of the dump; the batch queue runs it on its own thread.      */
+/* --------------------------------------------------------------------- */
+int decrypt_ps5_ppsa_app(
+    const char *sandbox,
+    const char *app_folder,
+    const char *usb_path,
+    int do_elf2fself,
+    int do_backport)
+{
+    char logpath[512];
+    snprintf(logpath, sizeof(logpath), "%s/log.txt", usb_path);
+
+    char src_game[1024], dst_game[1024];
+    snprintf(src_game, sizeof(src_game), "%s/%s", sandbox, app_folder);
+    snprintf(dst_game, sizeof(dst_game), "%s/%s", usb_path, app_folder);
+
+    write_log(logpath, "Starting decryption (elf2fself=%d, backport=%d)...", do_elf2fself, do_backport);
+    printf_notification("Decrypting...");
+    int dec_err = decrypt_all(src_game, dst_game, do_elf2fself, do_backport, 0);
+    if (dec_err == 0) {
+        write_log(logpath, "Decryption completed successfully.");
+        printf_notification("Decryption complete.");
+    } else {
+        write_log(logpath, "Decryption failed with code %d", dec_err);
+        printf_notification("Decryption failed (%d)", dec_err);
+    }
+    return dec_err;
+}
+
 /* --------------------------------------------------------------------- */
 /*  dump_ps5_ppsa_app() – main entry point                               */
 /* --------------------------------------------------------------------- */
@@ -77,10 +111,24 @@ int dump_ps5_ppsa_app(
 
     for (int i = 0; pkg_paths[i]; ++i) {
         snprintf(src_pkg, sizeof(src_pkg), pkg_paths[i], ppsa_short);
-        if (file_exists(src_pkg)) {
+        struct pkg_view pkg;
+        if (file_exists(src_pkg) && pkg_view_open(&pkg, src_pkg) == 0) {
             write_log(logpath, "Found package file: %s", src_pkg);
             printf_notification("Extracting package...");
-            unpkg_ps5(src_pkg, dst_game);
+            unpkg_ps5(&pkg, dst_game);
+
+            /* verify_pkg: stop here rather than after copying a broken title */
+            int corrupt = 0;
+            if (g_verify_pkg) {
+                printf_notification("Verifying package...");
+                corrupt = pkg_verify(&pkg, PKG_VERIFY_THREADS, NULL) < 0;
+            }
+            pkg_view_close(&pkg);
+            if (corrupt) {
+                write_log(logpath, "ERROR: %s failed the digest check, dump stopped", src_pkg);
+                printf_notification("ERROR: package is corrupt, dump stopped");
+                return -1;
+            }
             break;
         }
     }
@@ -96,9 +144,21 @@ int dump_ps5_ppsa_app(
     copy_start_time = 0;
     current_copied[0] = '\0';
 
-    /* ------------------- 3. CALCULATE TOTAL SIZE ------------------- */
-    size_walker(src_game, &folder_size_current);
-    if (folder_size_current == 0) {
+    /* ------------------- 3. PICK SOURCE & CALCULATE TOTAL SIZE ------------------- */
+    /* with decryption on, SELFs go only through decrypt_all() (step 10), so each
+       is written once: the sandbox copy and unpfs both skip them and leave them
+       out of the total */
+    g_route_self = do_decrypt;
+
+    /* the raw image, when readable and predicted faster; unpfs sizes it itself */
+    char nest_image[1024];
+    snprintf(nest_image, sizeof(nest_image), "%s/%s-nest/pfs_image.dat", sandbox, app_folder);
+    int from_image = file_exists(nest_image) &&
+                     plan_pfs_source(nest_image, src_game, NULL) == PLAN_IMAGE;
+
+    if (!from_image) size_walker_filtered(src_game, &folder_size_current);
+    if (!from_image && folder_size_current == 0) {
+        g_route_self = 0;
         write_log(logpath, "Warning: No files found in %s", src_game);
         return -1;
     }
@@ -115,8 +175,23 @@ int dump_ps5_ppsa_app(
     }
 
     /* ------------------- 5. COPY MAIN APP ------------------- */
-    write_log(logpath, "Copying main app: %s -> %s", src_game, dst_game);
-    copy_dir_recursive_tracked(src_game, dst_game);
+    if (from_image) {
+        write_log(logpath, "Extracting main app: %s -> %s%s", nest_image, dst_game,
+                  g_route_self ? " (SELFs left to the decrypter)" : "");
+        if (unpfs(nest_image, dst_game, NULL) != 0) {
+            write_log(logpath, "unpfs failed, copying the sandbox instead");
+            from_image = 0;
+            total_bytes_copied = 0;
+            folder_size_current = 0;
+            size_walker_filtered(src_game, &folder_size_current);
+        }
+    }
+    if (!from_image) {
+        write_log(logpath, "Copying main app: %s -> %s%s", src_game, dst_game,
+                  g_route_self ? " (SELFs left to the decrypter)" : "");
+        copy_dir_filtered(src_game, dst_game);
+    }
+    g_route_self = 0;
 
     /* ------------------- 6. STOP PROGRESS THREAD ------------------- */
     progress_thread_run = 0;
@@ -204,18 +279,8 @@ int dump_ps5_ppsa_app(
     }
 
     /* ------------------- 10. OPTIONAL DECRYPTION ------------------- */
-    if (do_decrypt) {
-        write_log(logpath, "Starting decryption (elf2fself=%d, backport=%d)...", do_elf2fself, do_backport);
-        printf_notification("Decrypting...");
-        int dec_err = decrypt_all(src_game, dst_game, do_elf2fself, do_backport, 0);
-        if (dec_err == 0) {
-            write_log(logpath, "Decryption completed successfully.");
-            printf_notification("Decryption complete.");
-        } else {
-            write_log(logpath, "Decryption failed with code %d", dec_err);
-            printf_notification("Decryption failed (%d)", dec_err);
-        }
-    }
+    if (do_decrypt)
+        decrypt_ps5_ppsa_app(sandbox, app_folder, usb_path, do_elf2fself, do_backport);
 
     /* ------------------- 11. FINALIZE ------------------- */
     write_log(logpath, "=== Dump complete (FLAT): %s ===", dst_game);
@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <sys/mman.h>
+#include <pthread.h>
 #include <sys/elf64.h>
 #include <sys/stat.h>
 
@@ -27,6 +28,10 @@
 #define PAGE_SIZE 0x4000
 #define SUPERPAGE_SIZE 0x200000
 
+// segments at least this big are decrypted by several threads, each locking its own range
+#define SEGMENT_SPLIT_MIN (32 * 1024 * 1024)
+#define SEGMENT_THREADS 4
+
 #define PT_SCE_DYNLIBDATA 0x61000000
 #define PT_SCE_RELRO 0x61000010
 #define PT_SCE_COMMENT 0x6FFFFF00
@@ -63,6 +68,10 @@ static intptr_t selfpagerops_addr = 0;
 static const int pagertab_vnodepagerops_index = 2;
 static const int pagertab_selfpagerops_index = 7;
 
+// the pagerops swap is global kernel state: selfpager_lock() (utils.c) keeps every
+// other mmap of a file out of it; everything after the mmap (mlock, copy, write)
+// can run in parallel
+
 static int init() {
     if (pagertab_addr != 0) {
         return 0;
@@ -204,8 +213,10 @@ static int init() {
 }
 
 void *mmap_self(void *addr, size_t len, int prot, int flags, int fd, off_t offset) {
+    selfpager_lock();
     int init_res = init();
     if (init_res != 0) {
+        selfpager_unlock();
         errno = init_res;
         return MAP_FAILED;
     }
@@ -215,10 +226,11 @@ void *mmap_self(void *addr, size_t len, int prot, int flags, int fd, off_t offse
     void *res = mmap(addr, len, prot, flags, fd, offset);
     // restore vnode pagerops
     kernel_setlong(pagertab_addr + (pagertab_vnodepagerops_index * 8), vnodepagerops_addr);
+    selfpager_unlock();
     return res;
 }
 
-void *map_self_segment(int fd, Elf64_Phdr *phdr, int segment_index) {
+static off_t self_segment_offset(Elf64_Phdr *phdr, int segment_index) {
     off_t offset = ((uint64_t)segment_index) << 32;
     if (fwver >= 0x900) {
         // for example, for this segment:
@@ -229,7 +241,131 @@ void *map_self_segment(int fd, Elf64_Phdr *phdr, int segment_index) {
         uint64_t aligned_vaddr = phdr->p_vaddr & ~(phdr->p_align - 1);
         offset |= aligned_vaddr & (SUPERPAGE_SIZE - 1);
     }
-    return mmap_self(NULL, phdr->p_filesz, PROT_READ, MAP_PRIVATE | MAP_ALIGNED(phdr->p_align), fd, offset);
+    return offset;
+}
+
+void *map_self_segment(int fd, Elf64_Phdr *phdr, int segment_index) {
+    return mmap_self(NULL, phdr->p_filesz, PROT_READ, MAP_PRIVATE | MAP_ALIGNED(phdr->p_align), fd,
+                     self_segment_offset(phdr, segment_index));
+}
+
+static int is_decrypted_segment(Elf64_Phdr *phdr) {
+    return (phdr->p_type == PT_LOAD || phdr->p_type == PT_SCE_DYNLIBDATA || phdr->p_type == PT_SCE_RELRO || phdr->p_type == PT_SCE_COMMENT) &&
+           phdr->p_filesz != 0;
+}
+
+// maps every segment decrypt_self needs under a single pagerops swap (two kernel writes per file
+// instead of two per segment); maps[i] is NULL for skipped segments
+// returns -1 with errno set and nothing left mapped if any mmap fails, failed_index is the segment
+static int map_self_segments(int fd, Elf64_Phdr *phdrs, int count, void **maps, int *failed_index) {
+    selfpager_lock();
+    int init_res = init();
+    if (init_res != 0) {
+        selfpager_unlock();
+        errno = init_res;
+        *failed_index = -1;
+        return -1;
+    }
+
+    int failed = -1;
+    kernel_setlong(pagertab_addr + (pagertab_vnodepagerops_index * 8), selfpagerops_addr);
+    for (int i = 0; i < count; i++) {
+        maps[i] = NULL;
+        if (failed != -1 || !is_decrypted_segment(&phdrs[i])) {
+            continue;
+        }
+        void *res = mmap(NULL, phdrs[i].p_filesz, PROT_READ, MAP_PRIVATE | MAP_ALIGNED(phdrs[i].p_align), fd,
+                         self_segment_offset(&phdrs[i], i));
+        if (res == MAP_FAILED) {
+            failed = i;
+        } else {
+            maps[i] = res;
+        }
+    }
+    kernel_setlong(pagertab_addr + (pagertab_vnodepagerops_index * 8), vnodepagerops_addr);
+    selfpager_unlock();
+
+    if (failed == -1) {
+        return 0;
+    }
+    int saved_errno = errno;
+    for (int i = 0; i < count; i++) {
+        if (maps[i]) {
+            munmap(maps[i], phdrs[i].p_filesz);
+            maps[i] = NULL;
+        }
+    }
+    errno = saved_errno;
+    *failed_index = failed;
+    return -1;
+}
+
+struct segment_range {
+    uint8_t *src;
+    uint8_t *dst;
+    size_t len;
+    int failed;
+    uint64_t usec;
+};
+
+static void *decrypt_range(void *arg) {
+    struct segment_range *range = arg;
+    uint64_t start = get_time_usec();
+    // faulting the pages in under mlock is what makes the self pager decrypt them
+    range->failed = mlock(range->src, range->len) != 0;
+    if (!range->failed) {
+        memcpy(range->dst, range->src, range->len);
+    }
+    range->usec = get_time_usec() - start;
+    return NULL;
+}
+
+// decrypts one mapped segment into dst; a big segment is split into page-aligned ranges
+// so its pages are decrypted and copied out by SEGMENT_THREADS threads instead of one
+static int decrypt_segment(int segment_index, void *src, void *dst, size_t len) {
+    int threads = len >= SEGMENT_SPLIT_MIN ? SEGMENT_THREADS : 1;
+    size_t chunk = ((len + threads - 1) / threads + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+
+    struct segment_range ranges[SEGMENT_THREADS];
+    int count = 0;
+    for (size_t off = 0; off < len && count < threads; off += chunk, count++) {
+        ranges[count].src = (uint8_t *)src + off;
+        ranges[count].dst = (uint8_t *)dst + off;
+        ranges[count].len = len - off < chunk ? len - off : chunk;
+        ranges[count].failed = 0;
+        ranges[count].usec = 0;
+    }
+
+    uint64_t start = get_time_usec();
+    pthread_t tids[SEGMENT_THREADS];
+    int started[SEGMENT_THREADS] = {0};
+    for (int t = 1; t < count; t++) {
+        started[t] = pthread_create(&tids[t], NULL, decrypt_range, &ranges[t]) == 0;
+    }
+    decrypt_range(&ranges[0]);
+    for (int t = 1; t < count; t++) {
+        if (started[t]) {
+            pthread_join(tids[t], NULL);
+        } else {
+            decrypt_range(&ranges[t]);
+        }
+    }
+    uint64_t wall = get_time_usec() - start;
+
+    int failed = 0;
+    uint64_t busy = 0;
+    for (int t = 0; t < count; t++) {
+        failed |= ranges[t].failed;
+        busy += ranges[t].usec;
+    }
+
+    // busy / wall: how many ranges were really being decrypted at once, compared to
+    // the single mlock of the whole segment this replaces
+    if (count > 1 && g_enable_logging && g_log_path[0]) {
+        write_log(g_log_path, "Segment %d: %.1f MB in %.1f ms on %d threads, %.2fx effective parallelism\n",
+                  segment_index, len / 1048576.0, wall / 1000.0, count, wall ? (double)busy / wall : 1.0);
+    }
+    return failed ? -1 : 0;
 }
 
 int decrypt_self(int input_file_fd, char **out_data, uint64_t *out_size) {
@@ -313,39 +449,44 @@ int decrypt_self(int input_file_fd, char **out_data, uint64_t *out_size) {
         return DECRYPT_ERROR_INTERNAL;
     }
 
-    for (int i = 0; i < elf_header.e_phnum; i++) {
-        Elf64_Phdr *phdr = &phdrs[i];
-        if ((phdr->p_type != PT_LOAD && phdr->p_type != PT_SCE_DYNLIBDATA && phdr->p_type != PT_SCE_RELRO && phdr->p_type != PT_SCE_COMMENT) || phdr->p_filesz == 0) {
-            continue;
-        }
-        void *mapped_segment = map_self_segment(input_file_fd, phdr, i);
-        if (mapped_segment == MAP_FAILED) {
-            if (errno == ENOSYS) {
-                if (g_enable_logging && g_log_path[0]) {
-                    write_log(g_log_path, "Unsupported firmware version\n");
-                }
-                munmap(out_buf, output_file_size);
-                return DECRYPT_ERROR_UNSUPPORTED_FW;
-            }
+    void *maps[elf_header.e_phnum];
+    int failed_index = -1;
+    if (map_self_segments(input_file_fd, phdrs, elf_header.e_phnum, maps, &failed_index) != 0) {
+        if (errno == ENOSYS) {
             if (g_enable_logging && g_log_path[0]) {
-                write_log(g_log_path, "Failed to mmap_self segment %d | errno: %d (%s)\n", i, errno, strerror(errno));
+                write_log(g_log_path, "Unsupported firmware version\n");
             }
             munmap(out_buf, output_file_size);
-            return DECRYPT_ERROR_INTERNAL;
+            return DECRYPT_ERROR_UNSUPPORTED_FW;
+        }
+        if (g_enable_logging && g_log_path[0]) {
+            write_log(g_log_path, "Failed to mmap_self segment %d | errno: %d (%s)\n", failed_index, errno, strerror(errno));
+        }
+        munmap(out_buf, output_file_size);
+        return DECRYPT_ERROR_INTERNAL;
+    }
+
+    // the pager lock is not held here: other threads decrypt their own files meanwhile
+    int res = 0;
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        Elf64_Phdr *phdr = &phdrs[i];
+        if (!maps[i]) {
+            continue;
         }
 
-        if (mlock(mapped_segment, phdr->p_filesz)) {
+        if (res == 0 && decrypt_segment(i, maps[i], (uint8_t *)out_buf + phdr->p_offset, phdr->p_filesz)) {
             if (g_enable_logging && g_log_path[0]) {
                 write_log(g_log_path, "Failed to decrypt segment data | segment %d\n", i);
             }
-            munmap(mapped_segment, phdr->p_filesz);
-            munmap(out_buf, output_file_size);
-            return DECRYPT_ERROR_FAILED_TO_DECRYPT_SEGMENT_DATA;
+            res = DECRYPT_ERROR_FAILED_TO_DECRYPT_SEGMENT_DATA;
         }
 
-        memcpy((uint8_t *)out_buf + phdr->p_offset, mapped_segment, phdr->p_filesz);
+        munmap(maps[i], phdr->p_filesz);
+    }
 
-        munmap(mapped_segment, phdr->p_filesz);
+    if (res != 0) {
+        munmap(out_buf, output_file_size);
+        return res;
     }
 
     if (version_segment_index != -1) {
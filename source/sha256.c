@@ -15,6 +15,10 @@
 /*************************** HEADER FILES ***************************/
 #include <stdlib.h>
 #include <memory.h>
+#if defined(__SHA__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define SHA256_NI 1
+#endif
 #include "sha256.h"
 
 /****************************** MACROS ******************************/
@@ -82,6 +86,58 @@ void sha256_transform(SHA256_CTX *ctx, const uint8_t data[])
 	ctx->state[7] += h;
 }
 
+#ifdef SHA256_NI
+/* SHA extensions (Zen 2 has them): two rounds per sha256rnds2, state kept
+   as ABEF / CDGH, message schedule four words at a time */
+static void sha256_blocks_ni(uint32_t state[8], const uint8_t *data, size_t nblocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);	// CDAB
+	__m128i st1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);	// EFGH
+	__m128i st0 = _mm_alignr_epi8(tmp, st1, 8);						// ABEF
+	st1 = _mm_blend_epi16(st1, tmp, 0xF0);							// CDGH
+
+	for (; nblocks; --nblocks, data += 64) {
+		__m128i abef = st0, cdgh = st1, w[4];
+		int i;
+
+		for (i = 0; i < 16; ++i) {
+			if (i < 4)
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), mask);
+			else
+				w[i & 3] = _mm_sha256msg2_epu32(
+					_mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]),
+						      _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4)),
+					w[(i + 3) & 3]);
+
+			__m128i msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i *)&k[i * 4]));
+			st1 = _mm_sha256rnds2_epu32(st1, st0, msg);
+			st0 = _mm_sha256rnds2_epu32(st0, st1, _mm_shuffle_epi32(msg, 0x0E));
+		}
+
+		st0 = _mm_add_epi32(st0, abef);
+		st1 = _mm_add_epi32(st1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(st0, 0x1B);		// FEBA
+	st1 = _mm_shuffle_epi32(st1, 0xB1);		// DCHG
+	st0 = _mm_blend_epi16(tmp, st1, 0xF0);		// DCBA
+	st1 = _mm_alignr_epi8(st1, tmp, 8);		// HGFE
+	_mm_storeu_si128((__m128i *)&state[0], st0);
+	_mm_storeu_si128((__m128i *)&state[4], st1);
+}
+#endif
+
+static void sha256_blocks(SHA256_CTX *ctx, const uint8_t *data, size_t nblocks)
+{
+#ifdef SHA256_NI
+	sha256_blocks_ni(ctx->state, data, nblocks);
+#else
+	for (; nblocks; --nblocks, data += 64)
+		sha256_transform(ctx, data);
+#endif
+}
+
 void sha256_init(SHA256_CTX *ctx)
 {
 	ctx->datalen = 0;
@@ -98,17 +154,34 @@ void sha256_init(SHA256_CTX *ctx)
 
 void sha256_update(SHA256_CTX *ctx, const uint8_t data[], size_t len)
 {
-	uint32_t i;
+	size_t n;
+
+	// Top up a partial block first, then hash whole blocks straight from data.
+	if (ctx->datalen) {
+		n = 64 - ctx->datalen;
+		if (n > len)
+			n = len;
+		memcpy(ctx->data + ctx->datalen, data, n);
+		ctx->datalen += n;
+		data += n;
+		len -= n;
+		if (ctx->datalen < 64)
+			return;
+		sha256_blocks(ctx, ctx->data, 1);
+		ctx->bitlen += 512;
+		ctx->datalen = 0;
+	}
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			sha256_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
-		}
+	n = len / 64;
+	if (n) {
+		sha256_blocks(ctx, data, n);
+		ctx->bitlen += 512ULL * n;
+		data += n * 64;
+		len -= n * 64;
 	}
+
+	memcpy(ctx->data, data, len);
+	ctx->datalen = (uint32_t)len;
 }
 
 void sha256_final(SHA256_CTX *ctx, uint8_t hash[])
@@ -127,7 +200,7 @@ void sha256_final(SHA256_CTX *ctx, uint8_t hash[])
 		ctx->data[i++] = 0x80;
 		while (i < 64)
 			ctx->data[i++] = 0x00;
-		sha256_transform(ctx, ctx->data);
+		sha256_blocks(ctx, ctx->data, 1);
 		memset(ctx->data, 0, 56);
 	}
 
@@ -141,7 +214,7 @@ void sha256_final(SHA256_CTX *ctx, uint8_t hash[])
 	ctx->data[58] = ctx->bitlen >> 40;
 	ctx->data[57] = ctx->bitlen >> 48;
 	ctx->data[56] = ctx->bitlen >> 56;
-	sha256_transform(ctx, ctx->data);
+	sha256_blocks(ctx, ctx->data, 1);
 
 	// Since this implementation uses little endian byte ordering and SHA uses big endian,
 	// reverse all the bytes when copying the final state to the output hash.
@@ -17,6 +17,7 @@ along with this program; see the file COPYING. If not, see
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <sys/stat.h>
@@ -26,9 +27,12 @@ along with this program; see the file COPYING. If not, see
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/aio.h>
+#include <sys/param.h>
+#include <sys/mount.h>
 #include <errno.h>
 
 #include "utils.h"
+#include "filter.h"
 
 size_t folder_size_current = 0;
 size_t total_bytes_copied = 0;
@@ -42,132 +46,264 @@ static char g_usb_homebrew[128] = {0};
 int g_enable_logging = 1;
 char g_log_path[512] = {0};
 int g_split_mode = 3;  // default: split both
+int g_pfs_threads = 4; // PFS extraction workers
+int g_pfs_backend = 0; // 0 = pread, 1 = mmap
+int g_pfs_benchmark = 0;
+int g_pfs_source = 0;  // 0 = auto, 1 = image, 2 = sandbox
+int g_verify_pkg = 0;  // 1 = check package digests before dumping
+int g_decrypt_threads = 4; // SELF decryption workers
+int g_route_self = 0;      // 1 = filtered copies leave SELFs to decrypt_all()
+
+#define USB_MAX_MOUNTS   8
+#define USB_BENCH_SIZE   (4 * 1024 * 1024)   /* 4 MB probe write */
+#define USB_BENCH_CHUNK  (256 * 1024)
+
+struct usb_probe {
+    char     root[32];
+    char     homebrew[128];
+    int      mounted;
+    int      writable;
+    int      has_config;
+    uint64_t free_bytes;
+    double   write_mbps;
+};
+
+uint64_t get_time_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
 
-int find_usb_and_setup(void) {
-    const char *possible_mounts[] = {
-        "/mnt/usb0", "/mnt/usb1", "/mnt/usb2", "/mnt/usb3",
-        "/mnt/usb4", "/mnt/usb5", "/mnt/usb6", "/mnt/usb7"
-    };
-    const int num_mounts = sizeof(possible_mounts) / sizeof(possible_mounts[0]);
-
-    for (int i = 0; i < num_mounts; ++i) {
-        const char *root = possible_mounts[i];
-        char homebrew[128], testfile[256], config[256];
-
-        snprintf(homebrew, sizeof(homebrew), "%s/homebrew", root);
-        snprintf(testfile, sizeof(testfile), "%s/.probe_usb", homebrew);
-        snprintf(config,   sizeof(config),   "%s/config.ini", homebrew);
-
-        g_enable_logging = read_logging_config();
-
-        if (!dir_exists(root)) continue;
-
-        mkdirs(homebrew);
-
-        int fd = open(testfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd != -1) {
-            if (write(fd, "PROBE", 5) == 5) {
-                close(fd);
-                unlink(testfile);
-
-                strncpy(g_usb_homebrew, homebrew, sizeof(g_usb_homebrew) - 1);
-                g_usb_homebrew[sizeof(g_usb_homebrew) - 1] = '\0';
-
-                if (!file_exists(config)) {
-                    FILE *f = fopen(config, "w");
-                    if (f) {
-                        fprintf(f, "; PS5 App Dumper Config\n");
-                        fprintf(f, "\n");
-                        fprintf(f, "; === Decrypt App ===\n");
-                        fprintf(f, "; enable_decrypter = 1  -> decrypt ELF files (default)\n");
-                        fprintf(f, "; enable_decrypter = 0  -> disable decryption\n");
-                        fprintf(f, "enable_decrypter = 1\n");
-                        fprintf(f, "\n");
-                        fprintf(f, "; === Backport Options PS4/PS5 ===\n");
-                        fprintf(f, "; enable_backport = 1 -> enable SDK patching (default)\n");
-                        fprintf(f, "; enable_backport = 0 -> disable SDK patching\n");
-                        fprintf(f, "; ps4_backport_level = 1-6 -> predefined SDK pair (default: 4 (PS4 9.00) )\n");
-                        fprintf(f, "; ps5_backport_level = 1-10 -> predefined SDK pair (default: 1 (PS5 1.00) )\n");
-                        fprintf(f, "; >>>> BACKPORTING IS FOR ADVANCED USERS MAY NOT WORK <<<<\n");
-                        fprintf(f, "enable_backport = 0\n");
-                        fprintf(f, "ps4_backport_level = 4\n");
-                        fprintf(f, "ps5_backport_level = 1\n");
-                        fprintf(f, "\n");
-                        fprintf(f, "; === FSELF Files ===\n");
-                        fprintf(f, "; enable_elf2fself = 1 -> enable fself ELF files (default)\n");
-                        fprintf(f, "; enable_elf2fself = 0 -> disable fself\n");
-                        fprintf(f, "enable_elf2fself = 0\n");
-                        fprintf(f, "\n");
-                        fprintf(f, "; === Logging ===\n");
-                        fprintf(f, "; enable_logging = 1 -> write log.txt (default)\n");
-                        fprintf(f, "; enable_logging = 0 -> disable logging\n");
-                        fprintf(f, "enable_logging = 1\n");
-                        fprintf(f, "\n");
-                        fprintf(f, "; === PS4 Split Mode ===\n");
-                        fprintf(f, "; 0 = no split (CUSAxxxxx/)\n");
-                        fprintf(f, "; 1 = app only (CUSAxxxxx-app/)\n");
-                        fprintf(f, "; 2 = patch only (CUSAxxxxx-patch/)\n");
-                        fprintf(f, "; 3 = both split (CUSAxxxxx-app/ + CUSAxxxxx-patch/)\n");
-                        fprintf(f, "split=3\n");
-                        fclose(f);
-                    }
-                }
-
-                snprintf(g_log_path, sizeof(g_log_path), "%s/log.txt", homebrew);
-
-                if (g_enable_logging && g_log_path[0]) {
-                    write_log(g_log_path,
-                              "USB detected (writable) at %s – %s",
-                              root, detect_fs_type(root));
-                }
-
-                return i;
-            }
-            close(fd);
-            unlink(testfile);
+uint64_t estimate_dir_usage(const char *path)
+{
+    struct statfs sfs;
+    if (!path || statfs(path, &sfs) != 0) return 0;
+    if (sfs.f_blocks < sfs.f_bfree) return 0;
+    return (uint64_t)(sfs.f_blocks - sfs.f_bfree) * (uint64_t)sfs.f_bsize;
+}
+
+static void write_default_config(const char *config)
+{
+    FILE *f = fopen(config, "w");
+    if (!f) return;
+
+    fprintf(f, "; PS5 App Dumper Config\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === Decrypt App ===\n");
+    fprintf(f, "; enable_decrypter = 1  -> decrypt ELF files (default)\n");
+    fprintf(f, "; enable_decrypter = 0  -> disable decryption\n");
+    fprintf(f, "enable_decrypter = 1\n");
+    fprintf(f, "; decrypt_threads = 1-8 -> SELFs decrypted in parallel (default: 4, 1 = serial)\n");
+    fprintf(f, "decrypt_threads = 4\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === Backport Options PS4/PS5 ===\n");
+    fprintf(f, "; enable_backport = 1 -> enable SDK patching (default)\n");
+    fprintf(f, "; enable_backport = 0 -> disable SDK patching\n");
+    fprintf(f, "; ps4_backport_level = 1-6 -> predefined SDK pair (default: 4 (PS4 9.00) )\n");
+    fprintf(f, "; ps5_backport_level = 1-10 -> predefined SDK pair (default: 1 (PS5 1.00) )\n");
+    fprintf(f, "; >>>> BACKPORTING IS FOR ADVANCED USERS MAY NOT WORK <<<<\n");
+    fprintf(f, "enable_backport = 0\n");
+    fprintf(f, "ps4_backport_level = 4\n");
+    fprintf(f, "ps5_backport_level = 1\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === FSELF Files ===\n");
+    fprintf(f, "; enable_elf2fself = 1 -> enable fself ELF files (default)\n");
+    fprintf(f, "; enable_elf2fself = 0 -> disable fself\n");
+    fprintf(f, "enable_elf2fself = 0\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === Logging ===\n");
+    fprintf(f, "; enable_logging = 1 -> write log.txt (default)\n");
+    fprintf(f, "; enable_logging = 0 -> disable logging\n");
+    fprintf(f, "enable_logging = 1\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === PS4 Split Mode ===\n");
+    fprintf(f, "; 0 = no split (CUSAxxxxx/)\n");
+    fprintf(f, "; 1 = app only (CUSAxxxxx-app/)\n");
+    fprintf(f, "; 2 = patch only (CUSAxxxxx-patch/)\n");
+    fprintf(f, "; 3 = both split (CUSAxxxxx-app/ + CUSAxxxxx-patch/)\n");
+    fprintf(f, "split=3\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === PFS Extraction ===\n");
+    fprintf(f, "; pfs_threads = 1-16 -> parallel file workers for pfs_image.dat (default: 4, 1 = serial)\n");
+    fprintf(f, "pfs_threads = 4\n");
+    fprintf(f, "; pfs_backend = pread | mmap -> how pfs_image.dat is read (default: pread)\n");
+    fprintf(f, "pfs_backend = pread\n");
+    fprintf(f, "; pfs_benchmark = 1 -> time both backends before extracting and log MB/s\n");
+    fprintf(f, "pfs_benchmark = 0\n");
+    fprintf(f, "; pfs_source = auto | image | sandbox -> read titles from pfs_image.dat or the mounted\n");
+    fprintf(f, ";   sandbox; auto times both and picks the faster one per title (default: auto)\n");
+    fprintf(f, "pfs_source = auto\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === Package Check ===\n");
+    fprintf(f, "; verify_pkg = 1 -> recompute the app/patch package SHA-256 digests first and stop\n");
+    fprintf(f, ";   before copying a corrupt or partially downloaded title (default: 0)\n");
+    fprintf(f, "verify_pkg = 0\n");
+    fprintf(f, "\n");
+    fprintf(f, "; === Selective Dump ===\n");
+    fprintf(f, "; include = <glob>[, <glob>...] -> only dump matching files/dirs (lines may repeat)\n");
+    fprintf(f, "; exclude = <glob>[, <glob>...] -> skip matching files/dirs\n");
+    fprintf(f, "; globs without '/' match names, with '/' the path from the app root\n");
+    fprintf(f, "; code-only example: include = eboot.bin, *.prx, *.sprx, sce_sys, sce_module\n");
+    fclose(f);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Probe one mount: statfs + short sequential write benchmark       */
+/* ----------------------------------------------------------------- */
+static void *usb_probe_thread(void *arg)
+{
+    struct usb_probe *p = arg;
+    struct statfs sfs;
+    char testfile[256], config[256];
+
+    /* An empty /mnt/usbN directory on the system partition is not a USB */
+    if (statfs(p->root, &sfs) != 0 || strcmp(sfs.f_mntonname, p->root) != 0)
+        return NULL;
+
+    p->mounted = 1;
+    p->free_bytes = (uint64_t)sfs.f_bavail * (uint64_t)sfs.f_bsize;
+
+    /* probe at the drive root: homebrew/ is only created on the drive picked */
+    snprintf(testfile, sizeof(testfile), "%s/.probe_usb", p->root);
+    snprintf(config,   sizeof(config),   "%s/config.ini", p->homebrew);
+
+    p->has_config = file_exists(config);
+
+    char *buf = malloc(USB_BENCH_CHUNK);
+    if (!buf) return NULL;
+    memset(buf, 0xA5, USB_BENCH_CHUNK);
+
+    int fd = open(testfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1) {
+        uint64_t start = get_time_usec();
+        size_t written = 0;
+        while (written < USB_BENCH_SIZE) {
+            if (write(fd, buf, USB_BENCH_CHUNK) != USB_BENCH_CHUNK) break;
+            written += USB_BENCH_CHUNK;
+        }
+        if (written == USB_BENCH_SIZE && fsync(fd) == 0) {
+            uint64_t elapsed = get_time_usec() - start;
+            if (elapsed == 0) elapsed = 1;
+            p->writable = 1;
+            p->write_mbps = (double)USB_BENCH_SIZE / (1024.0 * 1024.0) /
+                            ((double)elapsed / 1000000.0);
         }
+        close(fd);
+        unlink(testfile);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+int find_usb_and_setup(uint64_t required_bytes) {
+    struct usb_probe probes[USB_MAX_MOUNTS];
+    pthread_t threads[USB_MAX_MOUNTS];
+    int started[USB_MAX_MOUNTS] = {0};
+
+    memset(probes, 0, sizeof(probes));
+
+    /* Probe all mounts in parallel so a slow drive does not delay the rest */
+    for (int i = 0; i < USB_MAX_MOUNTS; ++i) {
+        snprintf(probes[i].root, sizeof(probes[i].root), "/mnt/usb%d", i);
+        snprintf(probes[i].homebrew, sizeof(probes[i].homebrew), "%s/homebrew", probes[i].root);
+        if (!dir_exists(probes[i].root)) continue;
+        if (pthread_create(&threads[i], NULL, usb_probe_thread, &probes[i]) == 0)
+            started[i] = 1;
+        else
+            usb_probe_thread(&probes[i]);
+    }
+    for (int i = 0; i < USB_MAX_MOUNTS; ++i) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+
+    /* Fastest writable drive with enough room, else the roomiest one */
+    int best = -1, roomiest = -1;
+    for (int i = 0; i < USB_MAX_MOUNTS; ++i) {
+        if (!probes[i].writable) continue;
+        if (roomiest < 0 || probes[i].free_bytes > probes[roomiest].free_bytes)
+            roomiest = i;
+        if (probes[i].free_bytes < required_bytes) continue;
+        if (best < 0 || probes[i].write_mbps > probes[best].write_mbps)
+            best = i;
+    }
+
+    if (best < 0 && roomiest >= 0) {
+        best = roomiest;
+        printf_notification("Warning: no USB has %.2f GB free, using %s",
+                            (double)required_bytes / (1024.0*1024.0*1024.0),
+                            probes[best].root);
+    }
 
-        if (file_exists(config)) {
-            printf_notification("USB (read-only fallback): %s", root);
-            strncpy(g_usb_homebrew, homebrew, sizeof(g_usb_homebrew) - 1);
-            g_usb_homebrew[sizeof(g_usb_homebrew) - 1] = '\0';
-            snprintf(g_log_path, sizeof(g_log_path), "%s/log.txt", homebrew);
+    if (best >= 0) {
+        struct usb_probe *p = &probes[best];
+        char config[256];
+        snprintf(config, sizeof(config), "%s/config.ini", p->homebrew);
 
-            if (g_enable_logging && g_log_path[0]) {
+        strncpy(g_usb_homebrew, p->homebrew, sizeof(g_usb_homebrew) - 1);
+        g_usb_homebrew[sizeof(g_usb_homebrew) - 1] = '\0';
+
+        mkdirs(p->homebrew);
+        if (!file_exists(config)) write_default_config(config);
+
+        snprintf(g_log_path, sizeof(g_log_path), "%s/log.txt", p->homebrew);
+
+        if (g_enable_logging && g_log_path[0]) {
+            for (int i = 0; i < USB_MAX_MOUNTS; ++i) {
+                if (!probes[i].mounted) continue;
                 write_log(g_log_path,
-                          "USB detected (read-only) at %s – %s",
-                          root, detect_fs_type(root));
+                          "USB candidate %s: %s, %.2f GB free, write %.1f MB/s",
+                          probes[i].root, probes[i].writable ? "writable" : "read-only",
+                          (double)probes[i].free_bytes / (1024.0*1024.0*1024.0),
+                          probes[i].write_mbps);
             }
-            return i;
+            write_log(g_log_path,
+                      "USB detected (writable) at %s – %s (need %.2f GB)",
+                      p->root, detect_fs_type(p->root),
+                      (double)required_bytes / (1024.0*1024.0*1024.0));
         }
+        return best;
+    }
+
+    for (int i = 0; i < USB_MAX_MOUNTS; ++i) {
+        struct usb_probe *p = &probes[i];
+        if (!p->mounted || !p->has_config) continue;
+
+        printf_notification("USB (read-only fallback): %s", p->root);
+        strncpy(g_usb_homebrew, p->homebrew, sizeof(g_usb_homebrew) - 1);
+        g_usb_homebrew[sizeof(g_usb_homebrew) - 1] = '\0';
+        snprintf(g_log_path, sizeof(g_log_path), "%s/log.txt", p->homebrew);
+
+        if (g_enable_logging && g_log_path[0]) {
+            write_log(g_log_path,
+                      "USB detected (read-only) at %s – %s",
+                      p->root, detect_fs_type(p->root));
+        }
+        return i;
     }
 
     return -1;
 }
 
 const char* detect_fs_type(const char *mountpoint) {
-    char cmd[256], line[256];
-    snprintf(cmd, sizeof(cmd), "mount | grep \"%s \"", mountpoint);
-    FILE *fp = popen(cmd, "r");
-    if (!fp) return "unknown";
-
-    if (fgets(line, sizeof(line), fp)) {
-        if (strstr(line, "exfat")) { pclose(fp); return "exFAT"; }
-        if (strstr(line, "vfat"))  { pclose(fp); return "FAT32"; }
-        if (strstr(line, "ntfs"))  { pclose(fp); return "NTFS"; }
-    }
-    pclose(fp);
+    struct statfs sfs;
+    if (statfs(mountpoint, &sfs) != 0) return "unknown";
+
+    if (!strcmp(sfs.f_fstypename, "exfat"))   return "exFAT";
+    if (!strcmp(sfs.f_fstypename, "msdosfs")) return "FAT32";
+    if (!strcmp(sfs.f_fstypename, "ntfs"))    return "NTFS";
     return "unknown";
 }
 
 void debug_list_usbs(void) {
-    FILE *fp = popen("mount | grep usb", "r");
-    if (!fp) return;
-    char line[256];
-    while (fgets(line, sizeof(line), fp)) {
-        printf_notification("Mounted USB: %s", line);
+    for (int i = 0; i < USB_MAX_MOUNTS; ++i) {
+        char root[32];
+        struct statfs sfs;
+        snprintf(root, sizeof(root), "/mnt/usb%d", i);
+        if (statfs(root, &sfs) != 0 || strcmp(sfs.f_mntonname, root) != 0) continue;
+        printf_notification("Mounted USB: %s (%s)", root, sfs.f_fstypename);
     }
-    pclose(fp);
 }
 
 const char* get_usb_homebrew_path(void) {
@@ -303,6 +439,94 @@ int read_split_config(void)
     return 3;
 }
 
+/* Generic "key = <value>" lookup: copies the first word, 0 when found */
+static int read_str_config(const char *key, char *out, size_t out_size)
+{
+    if (g_usb_homebrew[0] == '\0' || out_size == 0) return -1;
+
+    char config_path[256];
+    snprintf(config_path, sizeof(config_path), "%s/config.ini", g_usb_homebrew);
+
+    FILE *f = fopen(config_path, "r");
+    if (!f) return -1;
+
+    char line[256];
+    size_t klen = strlen(key);
+    int found = -1;
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (strncmp(p, key, klen) == 0 &&
+            (p[klen] == ' ' || p[klen] == '\t' || p[klen] == '=')) {
+            p += klen;
+            while (*p == ' ' || *p == '\t' || *p == '=') p++;
+            size_t n = 0;
+            while (p[n] && !isspace((unsigned char)p[n]) && p[n] != ';' && n + 1 < out_size) {
+                out[n] = p[n];
+                n++;
+            }
+            out[n] = '\0';
+            found = 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/* Generic "key = <int>" lookup, returns def when missing */
+static int read_int_config(const char *key, int def)
+{
+    char value[32];
+    if (read_str_config(key, value, sizeof(value)) != 0 ||
+        !isdigit((unsigned char)value[0]))
+        return def;
+    return atoi(value);
+}
+
+int read_pfs_threads_config(void)
+{
+    int threads = read_int_config("pfs_threads", 4);
+    if (threads < 1)  threads = 1;
+    if (threads > 16) threads = 16;
+    return threads;
+}
+
+int read_pfs_backend_config(void)
+{
+    char value[16];
+    if (read_str_config("pfs_backend", value, sizeof(value)) == 0 &&
+        strcasecmp(value, "mmap") == 0)
+        return 1;
+    return 0;
+}
+
+int read_pfs_benchmark_config(void)
+{
+    return read_int_config("pfs_benchmark", 0) ? 1 : 0;
+}
+
+int read_pfs_source_config(void)
+{
+    char value[16];
+    if (read_str_config("pfs_source", value, sizeof(value)) != 0) return 0;
+    if (strcasecmp(value, "image") == 0)   return 1;
+    if (strcasecmp(value, "sandbox") == 0) return 2;
+    return 0;
+}
+
+int read_verify_pkg_config(void)
+{
+    return read_int_config("verify_pkg", 0) ? 1 : 0;
+}
+
+int read_decrypt_threads_config(void)
+{
+    int threads = read_int_config("decrypt_threads", 4);
+    if (threads < 1) threads = 1;
+    if (threads > 8) threads = 8;
+    return threads;
+}
+
 int dir_exists(const char *path)
 {
     struct stat st;
@@ -616,6 +840,189 @@ void size_walker(const char *path, size_t *acc)
     closedir(d);
 }
 
+/* ----------------------------------------------------------------- */
+/*  SELF classification, shared with decrypt.c                       */
+/* ----------------------------------------------------------------- */
+int is_self_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    if (!ext) return 0;
+    return !strcasecmp(ext, ".elf") || !strcasecmp(ext, ".self") ||
+           !strcasecmp(ext, ".prx") || !strcasecmp(ext, ".sprx") ||
+           !strcasecmp(ext, ".bin");
+}
+
+int is_self_file(const char *path)
+{
+    const char *name = strrchr(path, '/');
+    if (!is_self_name(name ? name + 1 : path)) return 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    uint32_t magic = 0;
+    int ok = pread(fd, &magic, sizeof(magic), 0) == (ssize_t)sizeof(magic);
+    close(fd);
+    return ok && (magic == SELF_ORBIS_MAGIC || magic == SELF_PROSPERO_MAGIC);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Pager lock: while selfpager points the vnode pagerops at the     */
+/*  SELF pager, a file mmap from any other thread would get it too   */
+/* ----------------------------------------------------------------- */
+static pthread_mutex_t pager_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void selfpager_lock(void)
+{
+    pthread_mutex_lock(&pager_lock);
+}
+
+void selfpager_unlock(void)
+{
+    pthread_mutex_unlock(&pager_lock);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Filtered walks: 'rel' is the path below the walk root            */
+/*  With g_route_self set, SELFs are neither counted nor copied:     */
+/*  decrypt_all() writes them, once, decrypted.                      */
+/* ----------------------------------------------------------------- */
+
+/* SELFs the last routed size walk found, so the copy walk of the same
+   tree does not open every .bin/.prx/.sprx a second time for its magic */
+static struct {
+    char   root[1024];
+    char **rel;                 /* sorted once the size walk ends */
+    size_t count, cap;
+} g_selfs;
+
+static void selfs_clear(void)
+{
+    for (size_t i = 0; i < g_selfs.count; i++) free(g_selfs.rel[i]);
+    free(g_selfs.rel);
+    memset(&g_selfs, 0, sizeof(g_selfs));
+}
+
+/* a failed add only costs the copy walk one more magic check */
+static void selfs_add(const char *rel)
+{
+    if (g_selfs.count == g_selfs.cap) {
+        size_t ncap = g_selfs.cap ? g_selfs.cap * 2 : 64;
+        char **n = realloc(g_selfs.rel, ncap * sizeof(*n));
+        if (!n) return;
+        g_selfs.rel = n;
+        g_selfs.cap = ncap;
+    }
+    char *copy = strdup(rel);
+    if (copy) g_selfs.rel[g_selfs.count++] = copy;
+}
+
+static int rel_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* listed by the size walk: a SELF without reading it again */
+static int selfs_has(const char *rel)
+{
+    return g_selfs.count &&
+           bsearch(&rel, g_selfs.rel, g_selfs.count, sizeof(*g_selfs.rel), rel_cmp) != NULL;
+}
+
+static void size_walker_rel(const char *path, const char *rel, int keep_all, size_t *acc)
+{
+    DIR *d = opendir(path);
+    if (!d) return;
+
+    struct dirent *dp;
+    struct stat st;
+    char sub[1024], sub_rel[1024];
+
+    while ((dp = readdir(d)) != NULL)
+    {
+        if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) continue;
+        snprintf(sub, sizeof(sub), "%s/%s", path, dp->d_name);
+        snprintf(sub_rel, sizeof(sub_rel), "%s%s%s", rel, rel[0] ? "/" : "", dp->d_name);
+        if (stat(sub, &st) == 0)
+        {
+            int keep = filter_check(sub_rel, S_ISDIR(st.st_mode), keep_all);
+            if (keep == FILTER_SKIP) continue;
+            if (S_ISDIR(st.st_mode)) size_walker_rel(sub, sub_rel, keep == FILTER_KEEP_ALL, acc);
+            else if (S_ISREG(st.st_mode) && g_route_self && is_self_file(sub))
+                selfs_add(sub_rel);
+            else if (S_ISREG(st.st_mode))
+                *acc += (size_t)st.st_size;
+        }
+    }
+    closedir(d);
+}
+
+/* listed: the size walk of this tree classified its SELFs already */
+static void copy_dir_rel(const char *src, const char *dst, const char *rel, int keep_all,
+                         int listed)
+{
+    DIR *d = opendir(src);
+    if (!d) return;
+
+    /* a directory the rules only walk is created with its first file */
+    int made = !rel[0] || keep_all || !filter_active();
+    if (made) mkdirs(dst);
+
+    struct dirent *dp;
+    struct stat st;
+    char src_path[1024], dst_path[1024], sub_rel[1024];
+
+    while ((dp = readdir(d)) != NULL)
+    {
+        if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) continue;
+
+        snprintf(src_path, sizeof(src_path), "%s/%s", src, dp->d_name);
+        snprintf(dst_path, sizeof(dst_path), "%s/%s", dst, dp->d_name);
+        snprintf(sub_rel, sizeof(sub_rel), "%s%s%s", rel, rel[0] ? "/" : "", dp->d_name);
+
+        if (stat(src_path, &st) == 0)
+        {
+            /* excluded directories are never opened */
+            int keep = filter_check(sub_rel, S_ISDIR(st.st_mode), keep_all);
+            if (keep == FILTER_SKIP) continue;
+
+            if (S_ISDIR(st.st_mode)) {
+                copy_dir_rel(src_path, dst_path, sub_rel, keep == FILTER_KEEP_ALL, listed);
+                continue;
+            }
+            int self = g_route_self &&
+                       (listed ? is_self_name(dp->d_name) && selfs_has(sub_rel)
+                               : is_self_file(src_path));
+            if (!S_ISREG(st.st_mode) || self) continue;
+            if (!made) {
+                mkdirs(dst);
+                made = 1;
+            }
+            copy_file_track(src_path, dst_path);
+        }
+    }
+    closedir(d);
+}
+
+void size_walker_filtered(const char *path, size_t *acc)
+{
+    selfs_clear();
+    if (!filter_active() && !g_route_self) {
+        size_walker(path, acc);
+        return;
+    }
+    size_walker_rel(path, "", 0, acc);
+    if (!g_route_self) return;
+    strncpy(g_selfs.root, path, sizeof(g_selfs.root) - 1);
+    qsort(g_selfs.rel, g_selfs.count, sizeof(*g_selfs.rel), rel_cmp);
+}
+
+void copy_dir_filtered(const char *src, const char *dst)
+{
+    if (!filter_active() && !g_route_self) copy_dir_recursive_tracked(src, dst);
+    else copy_dir_rel(src, dst, "", 0, g_route_self && !strcmp(g_selfs.root, src));
+    selfs_clear();
+}
+
 void *progress_status_func(void *arg)
 {
     while (progress_thread_run)
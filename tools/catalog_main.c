@@ -0,0 +1,72 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "catalog.h"
+#include "utils.h"
+#include "host.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-t] [-v] [-c dir] [root]\n"
+            "  root     directory standing in for the console's / (default: /)\n"
+            "  -t       print wall time\n"
+            "  -v       log to stderr\n"
+            "  -c DIR   read and update DIR/" CATALOG_FILE "\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    int timing = 0, opt;
+    const char *cache_dir = NULL;
+
+    while ((opt = getopt(argc, argv, "tvc:h")) != -1) {
+        switch (opt) {
+        case 't': timing = 1; break;
+        case 'v': g_enable_logging = 1; break;
+        case 'c': cache_dir = optarg; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (argc - optind > 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    uint64_t start = get_time_usec();
+    struct catalog cat;
+    if (catalog_scan(&cat, optind < argc ? argv[optind] : "", cache_dir) != 0) {
+        fprintf(stderr, "catalog: scan failed\n");
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < cat.count; i++) {
+        const struct catalog_entry *e = &cat.items[i];
+        printf("%-12s %-5s %-8s %-40s %14llu\n", e->title_id, e->kind,
+               e->version[0] ? e->version : "-", e->content_id[0] ? e->content_id : "-",
+               (unsigned long long)e->size);
+        bytes += e->size;
+    }
+    if (timing)
+        fprintf(stderr, "catalog: %zu packages (%zu read), %.1f GB listed in %.1f ms\n",
+                cat.count, cat.refreshed, bytes / 1073741824.0, (get_time_usec() - start) / 1000.0);
+    catalog_free(&cat);
+    return 0;
+}
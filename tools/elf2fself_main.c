@@ -0,0 +1,59 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "elf2fself.h"
+#include "utils.h"
+#include "host.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-t] [-v] <in.elf> <out.self>\n"
+            "  -t  print wall time and throughput\n"
+            "  -v  log to stderr\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    int timing = 0, opt;
+
+    while ((opt = getopt(argc, argv, "tvh")) != -1) {
+        switch (opt) {
+        case 't': timing = 1; break;
+        case 'v': g_enable_logging = 1; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    struct stat st;
+    uint64_t bytes = stat(argv[optind], &st) == 0 ? (uint64_t)st.st_size : 0;
+
+    uint64_t start = get_time_usec();
+    if (elf2fself(argv[optind], argv[optind + 1]) != 0) {
+        fprintf(stderr, "elf2fself: failed on %s\n", argv[optind]);
+        return 1;
+    }
+    if (timing) host_report("elf2fself", start, bytes);
+    return 0;
+}
@@ -0,0 +1,29 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+/* index sidecars go to <dir>/pfs_index when set */
+void host_set_homebrew(const char *dir);
+
+/* "what: X MB in Y s (Z MB/s)" on stderr */
+void host_report(const char *what, uint64_t start_usec, uint64_t bytes);
+
+#endif /* HOST_H */
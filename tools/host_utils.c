@@ -0,0 +1,151 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+/* Host build of the utils.c pieces the parsers use: logging goes to
+   stderr, notifications are printed, there is no USB homebrew folder
+   unless a tool sets one with host_set_homebrew(). */
+
+#include <sys/stat.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "utils.h"
+#include "host.h"
+
+size_t folder_size_current = 0;
+size_t total_bytes_copied = 0;
+char current_copied[256] = {0};
+int progress_thread_run = 0;
+time_t copy_start_time = 0;
+pthread_t progress_thread;
+
+int g_enable_logging = 0;
+char g_log_path[512] = "stderr";
+int g_split_mode = 3;
+int g_pfs_threads = 4;
+int g_pfs_backend = 0;
+int g_pfs_benchmark = 0;
+int g_pfs_source = 0;
+int g_route_self = 0;
+
+static char g_homebrew[512] = {0};
+
+void host_set_homebrew(const char *dir)
+{
+    strncpy(g_homebrew, dir ? dir : "", sizeof(g_homebrew) - 1);
+    g_homebrew[sizeof(g_homebrew) - 1] = '\0';
+}
+
+const char *get_usb_homebrew_path(void)
+{
+    return g_homebrew;
+}
+
+int is_self_name(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    if (!ext) return 0;
+    return !strcasecmp(ext, ".elf") || !strcasecmp(ext, ".self") ||
+           !strcasecmp(ext, ".prx") || !strcasecmp(ext, ".sprx") ||
+           !strcasecmp(ext, ".bin");
+}
+
+/* no SELF pager on the host: nothing swaps the vnode pagerops */
+void selfpager_lock(void)
+{
+}
+
+void selfpager_unlock(void)
+{
+}
+
+int write_log(const char *log_file_path, const char *fmt, ...)
+{
+    (void)log_file_path;
+    if (!g_enable_logging) return 0;
+
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    return 0;
+}
+
+void printf_notification(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fputs("[notify] ", stderr);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+int sceKernelSendNotificationRequest(int device, SceNotificationRequest *req, size_t size, int blocking)
+{
+    (void)device; (void)size; (void)blocking;
+    if (req) fprintf(stderr, "[notify] %s\n", req->message);
+    return 0;
+}
+
+uint64_t get_time_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+int dir_exists(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+int file_exists(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+void mkdirs(const char *path)
+{
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(tmp, 0777);
+            *p = '/';
+        }
+    }
+    mkdir(tmp, 0777);
+}
+
+/* ----------------------------------------------------------------- */
+/*  Shared CLI helpers                                               */
+/* ----------------------------------------------------------------- */
+void host_report(const char *what, uint64_t start_usec, uint64_t bytes)
+{
+    double secs = (double)(get_time_usec() - start_usec) / 1e6;
+    double mb   = (double)bytes / (1024.0 * 1024.0);
+    fprintf(stderr, "%s: %.1f MB in %.3f s (%.1f MB/s)\n",
+            what, mb, secs, secs > 0 ? mb / secs : 0.0);
+}
@@ -0,0 +1,135 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pfs.h"
+#include "ps4_pkg.h"
+#include "planner.h"
+#include "utils.h"
+#include "host.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-j threads] [-b pread|mmap] [-t] [-B] [-i dir] [-l] [-v]\n"
+            "          [-o offset [-n size] | -k | -P dir] <pfs_image.dat> [out_dir] [path ...]\n"
+            "  -j N     extraction workers, 1-16 (default 4)\n"
+            "  -b NAME  image backend: pread (default) or mmap\n"
+            "  -t       print wall time and throughput\n"
+            "  -B       benchmark both backends before extracting\n"
+            "  -i DIR   cache the parsed tree in DIR/pfs_index\n"
+            "  -l       list the image instead of extracting\n"
+            "  -v       log to stderr\n"
+            "  -o OFF   the image starts at byte OFF of the file\n"
+            "  -n LEN   and is LEN bytes long (default: to the end)\n"
+            "  -k       the file is a PS4 fake PKG: extract its inner pfs_image.dat\n"
+            "  -P DIR   compare the image with its mounted copy in DIR and print the plan\n"
+            "  paths    extract only these files / directories\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    int timing = 0, list = 0, pkg = 0, ranged = 0, opt;
+    uint64_t base = 0, size = 0;
+    const char *plan_dir = NULL;
+
+    while ((opt = getopt(argc, argv, "j:b:tBi:lvo:n:kP:h")) != -1) {
+        switch (opt) {
+        case 'j': g_pfs_threads = atoi(optarg); break;
+        case 'b':
+            if (strcmp(optarg, "mmap") == 0) g_pfs_backend = PFS_BACKEND_MMAP;
+            else if (strcmp(optarg, "pread") == 0) g_pfs_backend = PFS_BACKEND_PREAD;
+            else { usage(argv[0]); return 2; }
+            break;
+        case 't': timing = 1; break;
+        case 'B': g_pfs_benchmark = 1; g_enable_logging = 1; break;
+        case 'i': host_set_homebrew(optarg); break;
+        case 'l': list = 1; break;
+        case 'v': g_enable_logging = 1; break;
+        case 'o': base = strtoull(optarg, NULL, 0); ranged = 1; break;
+        case 'n': size = strtoull(optarg, NULL, 0); ranged = 1; break;
+        case 'k': pkg = 1; break;
+        case 'P': plan_dir = optarg; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (g_pfs_threads < 1)  g_pfs_threads = 1;
+    if (g_pfs_threads > 16) g_pfs_threads = 16;
+
+    int left = argc - optind;
+    if (plan_dir && left == 1) {
+        struct pfs_plan plan;
+        if (plan_pfs_source(argv[optind], plan_dir, &plan) < 0) {
+            fprintf(stderr, "unpfs: nothing to plan for %s\n", argv[optind]);
+            return 1;
+        }
+        printf("%s: %llu files, %llu bytes, image %.2f s, sandbox %.2f s\n",
+               plan.source == PLAN_IMAGE ? "image" : "sandbox",
+               (unsigned long long)plan.files, (unsigned long long)plan.bytes,
+               plan.image_secs, plan.sandbox_secs);
+        return 0;
+    }
+    if (left < 1 || (!list && left < 2)) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *image = argv[optind];
+
+    /* ranges are extracted whole: no listing or path selection */
+    if ((ranged || pkg) && (list || left > 2 || (ranged && pkg))) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (pkg) {
+        uint64_t outer_off, outer_size;
+        struct pkg_view view;
+        int found = 0;
+        if (pkg_view_open(&view, image) == 0) {
+            found = pkg_ps4_pfs_range(&view, &outer_off, &outer_size) == 0;
+            pkg_view_close(&view);
+        }
+        if (!found ||
+            pfs_locate_file(image, outer_off, outer_size, "pfs_image.dat", &base, &size) != 0) {
+            fprintf(stderr, "unpfs: no readable pfs_image.dat in %s\n", image);
+            return 1;
+        }
+        ranged = 1;
+    }
+
+    uint64_t start = get_time_usec();
+    int ret;
+    if (list) {
+        ret = unpfs_list(image, stdout);
+    } else if (left > 2) {
+        ret = unpfs_select(image, argv[optind + 1], (const char *const *)&argv[optind + 2],
+                           (size_t)(left - 2), NULL);
+    } else if (ranged) {
+        ret = unpfs_range(image, base, size, argv[optind + 1], NULL);
+    } else {
+        ret = unpfs(image, argv[optind + 1], NULL);
+    }
+
+    if (ret != 0) {
+        fprintf(stderr, "unpfs: failed on %s\n", image);
+        return 1;
+    }
+    if (timing) host_report(list ? "list" : "extract", start, total_bytes_copied);
+    return 0;
+}
@@ -0,0 +1,106 @@
+/* Copyright (C) 2025 EchoStretch
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 3, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING. If not, see
+<http://www.gnu.org/licenses/>.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ps4_pkg.h"
+#include "ps5_pkg.h"
+#include "pkg_verify.h"
+#include "utils.h"
+#include "host.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-4|-5] [-t] [-v] [-V] [-c dir] <file.pkg> <out_dir>\n"
+            "  -4 / -5  force the PS4 or PS5 extractor (default: by magic)\n"
+            "  -t       print wall time and throughput\n"
+            "  -v       log to stderr\n"
+            "  -V       check the package digests after extracting (exit 3 on mismatch)\n"
+            "  -c DIR   keep the PS5 CNT offset cache in DIR\n", prog);
+}
+
+/* 4 = "\x7fCNT", 5 = PS5 magic, 0 = unknown */
+static int detect_pkg(const struct pkg_view *v)
+{
+    uint8_t hdr[4];
+    if (pkg_view_read(v, hdr, sizeof(hdr), 0) != 0) return 0;
+
+    uint32_t magic = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+    if (magic == PS5_PKG_MAGIC) return 5;
+    if (hdr[0] == 0x7F && hdr[1] == 'C' && hdr[2] == 'N' && hdr[3] == 'T') return 4;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int kind = 0, timing = 0, verify = 0, opt;
+
+    while ((opt = getopt(argc, argv, "45tvVc:h")) != -1) {
+        switch (opt) {
+        case '4': kind = 4; break;
+        case '5': kind = 5; break;
+        case 't': timing = 1; break;
+        case 'v': g_enable_logging = 1; break;
+        case 'V': verify = 1; break;
+        case 'c': host_set_homebrew(optarg); break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *pkg = argv[optind];
+    const char *out = argv[optind + 1];
+
+    uint64_t start = get_time_usec();
+    struct pkg_view view;
+    if (pkg_view_open(&view, pkg) != 0) {
+        fprintf(stderr, "unpkg: cannot open %s\n", pkg);
+        return 1;
+    }
+
+    if (!kind) kind = detect_pkg(&view);
+    if (!kind) {
+        fprintf(stderr, "unpkg: %s is not a PS4/PS5 package\n", pkg);
+        pkg_view_close(&view);
+        return 1;
+    }
+
+    uint64_t bytes = view.file_size;
+    mkdirs(out);
+    int ret = kind == 4 ? unpkg_ps4(&view, out) : unpkg_ps5(&view, out);
+    if (timing && ret == 0) host_report("unpkg (package size)", start, bytes);
+
+    int bad = 0;
+    if (ret == 0 && verify) {
+        struct pkg_verify_result check;
+        bad = pkg_verify(&view, PKG_VERIFY_THREADS, &check) < 0;
+        printf("verify: %d regions, %d failed, %.1f MB in %.3f s (%.1f MB/s)\n",
+               check.checked, check.failed, check.bytes / 1048576.0, check.secs,
+               check.secs > 0 ? check.bytes / 1048576.0 / check.secs : 0.0);
+    }
+    pkg_view_close(&view);
+    if (ret != 0) {
+        fprintf(stderr, "unpkg: failed on %s (%d)\n", pkg, ret);
+        return 1;
+    }
+    return bad ? 3 : 0;
+}